@@ -0,0 +1,277 @@
+#include "Animation.h"
+
+namespace
+{
+    Vector3 lerp(const Vector3 &a, const Vector3 &b, Real weight)
+    {
+        return a + (b - a) * weight;
+    }
+
+    // the key at or before frame in previous and the key after it in next with the weight of next,
+    // frames outside the keys hold the first or the last key with a weight of 0. keys is not empty
+    template <typename Key>
+    void keysAround(const std::vector<Key> &keys, int frame, const Key *&previous, const Key *&next, Real &weight)
+    {
+        size_t k = 0;
+        while (k < keys.size() && keys[k].frame <= frame)
+        {
+            k++;
+        }
+
+        previous = &keys[k > 0 ? k - 1 : 0];
+        next = &keys[k < keys.size() ? k : keys.size() - 1];
+        weight = previous->frame < next->frame ? Real(frame - previous->frame) / (next->frame - previous->frame) : 0;
+        if (weight <= 0)
+        {
+            weight = 0;
+            next = previous;
+        }
+    }
+
+    Transform keyTransform(const Vector3 &scaling, const Transform &rotation, const Vector3 &translation)
+    {
+        return Transform::translation(translation) * rotation * Transform::scaling(scaling);
+    }
+
+    // unit quaternion of a rotation, w = cos(angle / 2) and v = sin(angle / 2) * axis
+    class Rotation {
+    public:
+        Real w;
+        Vector3 v;
+    };
+
+    Rotation keyRotation(const ObjectKey &key)
+    {
+        Real halfAngle = key.angle * Real(M_PI / 360);
+        return Rotation{std::cos(halfAngle), std::sin(halfAngle) * key.axis.normalize()};
+    }
+
+    // spherical linear interpolation along the shorter arc, q and -q are the same rotation so the arc between
+    // them is never longer than half a turn. rotations close enough for sin(arc) to vanish are blended linearly
+    Rotation slerp(const Rotation &a, Rotation b, Real weight)
+    {
+        Real cosArc = a.w * b.w + dot(a.v, b.v);
+        if (cosArc < 0)
+        {
+            b.w = -b.w;
+            b.v = -b.v;
+            cosArc = -cosArc;
+        }
+
+        Real weightA = 1 - weight;
+        Real weightB = weight;
+        if (cosArc < Real(0.9995))
+        {
+            Real arc = std::acos(cosArc);
+            weightA = std::sin((1 - weight) * arc) / std::sin(arc);
+            weightB = std::sin(weight * arc) / std::sin(arc);
+        }
+
+        Rotation blend{weightA * a.w + weightB * b.w, weightA * a.v + weightB * b.v};
+        Real length = std::sqrt(blend.w * blend.w + dot(blend.v, blend.v));
+        return Rotation{blend.w / length, blend.v / length};
+    }
+
+    Transform rotationTransform(const Rotation &rotation)
+    {
+        Real sinHalfAngle = rotation.v.length();
+        if (sinHalfAngle == 0)
+        {
+            return Transform();
+        }
+        Real angle = 2 * std::atan2(sinHalfAngle, rotation.w) * Real(180 / M_PI);
+        return Transform::rotation(angle, rotation.v / sinHalfAngle);
+    }
+}
+
+CameraKey cameraKeyAt(const CameraTrack &track, int frame)
+{
+    const CameraKey *previous;
+    const CameraKey *next;
+    Real weight;
+    keysAround(track.keys, frame, previous, next, weight);
+    if (weight == 0)
+    {
+        return *previous;
+    }
+
+    // cameraSetup needs a unit gaze and a unit up orthogonal to it
+    CameraKey key;
+    key.frame = frame;
+    key.position = lerp(previous->position, next->position, weight);
+    key.gaze = lerp(previous->gaze, next->gaze, weight).normalize();
+    Vector3 up = lerp(previous->up, next->up, weight);
+    key.up = (up - dot(up, key.gaze) * key.gaze).normalize();
+    return key;
+}
+
+Transform objectTransformAt(const ObjectTrack &track, int frame)
+{
+    if (track.keys.empty())
+    {
+        return Transform();
+    }
+
+    const ObjectKey *previous;
+    const ObjectKey *next;
+    Real weight;
+    keysAround(track.keys, frame, previous, next, weight);
+    if (weight == 0)
+    {
+        return keyTransform(previous->scaling, Transform::rotation(previous->angle, previous->axis), previous->translation);
+    }
+
+    Rotation rotation = slerp(keyRotation(*previous), keyRotation(*next), weight);
+    return keyTransform(lerp(previous->scaling, next->scaling, weight), rotationTransform(rotation),
+                        lerp(previous->translation, next->translation, weight));
+}
+
+void SceneAnimator::setup(const Scene &scene, const CompiledScene &compiled)
+{
+    const Animation &animation = scene.animation;
+
+    // mesh tracks move the Mesh objects with their id, Triangle objects sharing it stay. the compiled
+    // triangles keep the index of their mesh, wherever the BVH build moved them
+    meshTracks.assign(scene.meshes.size(), -1);
+    for (size_t t = 0; t < animation.meshTracks.size(); t++)
+    {
+        for (size_t m = 0; m < scene.meshes.size(); m++)
+        {
+            if (!scene.meshes[m].isTriangle && scene.meshes[m].id == animation.meshTracks[t].objectId)
+            {
+                meshTracks[m] = t;
+            }
+        }
+    }
+    triangleIndices.clear();
+    restTriangles.clear();
+    triangleTracks.clear();
+    for (size_t i = 0; i < compiled.triangles.size(); i++)
+    {
+        int meshIndex = compiled.triangles[i].meshIndex;
+        if (meshIndex >= 0 && meshTracks[meshIndex] >= 0)
+        {
+            triangleIndices.push_back(i);
+            restTriangles.push_back(compiled.triangles[i]);
+            triangleTracks.push_back(meshTracks[meshIndex]);
+        }
+    }
+
+    instancePlacements.clear();
+    instanceTracks.clear();
+    for (size_t t = 0; t < animation.instanceTracks.size(); t++)
+    {
+        instanceTracks[animation.instanceTracks[t].objectId] = t;
+    }
+    for (const CompiledInstance &instance : compiled.instances.instances)
+    {
+        if (instance.sceneMesh < 0 && instanceTracks.count(instance.id))
+        {
+            instancePlacements[instance.id] = instance.objectToWorld;
+        }
+    }
+
+    meshTransforms.assign(animation.meshTracks.size(), Transform());
+    instanceTransforms.assign(animation.instanceTracks.size(), Transform());
+}
+
+bool SceneAnimator::applyFrame(int frame, Scene *scene, CompiledScene *compiled)
+{
+    const Animation &animation = scene->animation;
+
+    for (const CameraTrack &track : animation.cameraTracks)
+    {
+        if (track.keys.empty())
+        {
+            continue;
+        }
+        CameraKey key = cameraKeyAt(track, frame);
+        for (Camera &camera : scene->cameras)
+        {
+            if (camera.id == track.cameraId)
+            {
+                camera.position = key.position;
+                camera.gaze = key.gaze;
+                camera.up = key.up;
+            }
+        }
+    }
+
+    // meshes and instances holding still since the last frame are left alone
+    bool meshesMoved = false;
+    for (size_t t = 0; t < animation.meshTracks.size(); t++)
+    {
+        Transform transform = objectTransformAt(animation.meshTracks[t], frame);
+        if (transform != meshTransforms[t])
+        {
+            meshTransforms[t] = transform;
+            meshesMoved = true;
+        }
+    }
+    bool instancesMoved = false;
+    for (size_t t = 0; t < animation.instanceTracks.size(); t++)
+    {
+        Transform transform = objectTransformAt(animation.instanceTracks[t], frame);
+        if (transform != instanceTransforms[t])
+        {
+            instanceTransforms[t] = transform;
+            instancesMoved = true;
+        }
+    }
+
+    if (meshesMoved && !triangleIndices.empty())
+    {
+        for (size_t i = 0; i < triangleIndices.size(); i++)
+        {
+            const Transform &transform = meshTransforms[triangleTracks[i]];
+            const CompiledTriangle &rest = restTriangles[i];
+            CompiledTriangle &triangle = compiled->triangles[triangleIndices[i]];
+            triangle.vertex = transform.point(rest.vertex);
+            triangle.edge1 = transform.vector(rest.edge1);
+            triangle.edge2 = transform.vector(rest.edge2);
+        }
+
+        // the triangles keep their order, so the BVH only needs new bounds
+        if (!compiled->bvh.nodes.empty())
+        {
+            compiled->bvh.refit(compiled->triangles, compiled->spheres);
+        }
+        else
+        {
+            compiled->blocks.clear();
+            packTriangleBlocks(compiled->triangles, 0, compiled->triangles.size(), compiled->blocks);
+        }
+    }
+
+    // an animated mesh that instances place is stored with them, and moved where the scene defines it
+    // through the copy placing it there
+    bool placementsMoved = false;
+    InstanceBVH &instances = compiled->instances;
+    for (size_t i = 0; i < instances.instances.size(); i++)
+    {
+        const CompiledInstance &instance = instances.instances[i];
+        if (instance.sceneMesh >= 0)
+        {
+            int track = meshTracks[instance.sceneMesh];
+            if (meshesMoved && track >= 0)
+            {
+                instances.setTransform(i, meshTransforms[track]);
+                placementsMoved = true;
+            }
+            continue;
+        }
+
+        auto track = instanceTracks.find(instance.id);
+        if (instancesMoved && track != instanceTracks.end())
+        {
+            instances.setTransform(i, instanceTransforms[track->second] * instancePlacements[instance.id]);
+            placementsMoved = true;
+        }
+    }
+    if (placementsMoved)
+    {
+        instances.buildTopLevel();
+    }
+
+    return meshesMoved || instancesMoved;
+}
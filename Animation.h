@@ -0,0 +1,51 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <map>
+#include <vector>
+#include "SceneXmlModel.h"
+#include "CompiledScene.h"
+
+// pose of a camera track with at least one key at frame, interpolated between the keys around it. gaze and up are
+// renormalized between keys, on a key they are used as given like those of the scene cameras
+CameraKey cameraKeyAt(const CameraTrack &track, int frame);
+
+// scaling, rotation and translation of an object track at frame, each interpolated on its own. the rotation
+// turns the shorter way from one key to the next, so keys more than half a turn apart need one in between
+Transform objectTransformAt(const ObjectTrack &track, int frame);
+
+// moves a compiled scene from frame to frame of its animation. everything that is not animated is
+// kept as it was compiled, a frame that only moves cameras does not touch the geometry at all.
+// the triangles of animated meshes are placed from their compiled positions and the BVH is refitted
+// over them rather than rebuilt, animated instances get a new transform and the small top level is rebuilt.
+// instances always place a mesh as it was compiled, whether the mesh itself is animated or not. a mesh that
+// instances place is only stored with them, a track on it moves the copy placing it where the scene defines it
+class SceneAnimator {
+public:
+    // remembers where the animated triangles and instances are, compiled has to be as compileScene left it
+    void setup(const Scene &scene, const CompiledScene &compiled);
+
+    // poses the animated cameras of scene and the animated geometry of compiled for frame,
+    // returns true when any geometry moved
+    bool applyFrame(int frame, Scene *scene, CompiledScene *compiled);
+
+private:
+    // for every triangle of an animated mesh, its index in the compiled triangles,
+    // its compiled position and the mesh track moving it
+    std::vector<int> triangleIndices;
+    std::vector<CompiledTriangle> restTriangles;
+    std::vector<int> triangleTracks;
+
+    // mesh track of every mesh of the scene, -1 when it is not animated
+    std::vector<int> meshTracks;
+
+    // compiled placement of every animated instance by id, and its track
+    std::map<int, Transform> instancePlacements;
+    std::map<int, int> instanceTracks;
+
+    // transforms of the mesh and instance tracks at the frame applied last, they start as the identity
+    std::vector<Transform> meshTransforms;
+    std::vector<Transform> instanceTransforms;
+};
+
+#endif // ANIMATION_H
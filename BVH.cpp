@@ -0,0 +1,833 @@
+#include "BVH.h"
+#include <algorithm>
+#include <chrono>
+#include "RayPacket.h"
+#include "RenderStats.h"
+
+namespace
+{
+    const int BIN_COUNT = 16;
+    const int MAX_LEAF_SIZE = 2 * SIMD_WIDTH;
+    // also bounds the traversal stack, deeper nodes are turned into leaves
+    const int MAX_DEPTH = 64;
+
+    // relative costs used by the surface area heuristic,
+    // leaves are intersected a whole triangle block at a time
+    const double TRAVERSAL_COST = 1.0;
+    const double INTERSECTION_COST = 1.0;
+
+    int blockCount(int triangleCount)
+    {
+        return (triangleCount + SIMD_WIDTH - 1) / SIMD_WIDTH;
+    }
+
+    // intersection cost of count primitives, triangles are tested a block at a time and spheres one at a time
+    double primitiveCost(int count, int sphereCount)
+    {
+        return blockCount(count - sphereCount) + sphereCount;
+    }
+
+    class Bin {
+    public:
+        AABB bounds;
+        int count = 0;
+        int sphereCount = 0;
+    };
+
+    double axisOf(const Vector3 &v, int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+}
+
+void BVH::build(std::vector<CompiledTriangle> &triangles, SphereArray &spheres)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    nodes.clear();
+    blocks.clear();
+    stats = BVHStats();
+
+    int triangleCount = triangles.size();
+    std::vector<BVHBuildPrimitive> buildPrimitives(triangleCount + spheres.size());
+    for (int i = 0; i < triangleCount; i++)
+    {
+        const CompiledTriangle &triangle = triangles[i];
+
+        BVHBuildPrimitive &buildPrimitive = buildPrimitives[i];
+        buildPrimitive.index = i;
+        buildPrimitive.isSphere = false;
+        buildPrimitive.bounds.expand(triangle.vertex);
+        buildPrimitive.bounds.expand(triangle.vertex + triangle.edge1);
+        buildPrimitive.bounds.expand(triangle.vertex + triangle.edge2);
+        buildPrimitive.centroid = 0.5 * (buildPrimitive.bounds.min + buildPrimitive.bounds.max);
+    }
+    for (int i = 0; i < spheres.size(); i++)
+    {
+        Vector3 center = spheres.center(i);
+        Vector3 extent(spheres.radius[i], spheres.radius[i], spheres.radius[i]);
+
+        BVHBuildPrimitive &buildPrimitive = buildPrimitives[triangleCount + i];
+        buildPrimitive.index = i;
+        buildPrimitive.isSphere = true;
+        buildPrimitive.bounds.expand(center - extent);
+        buildPrimitive.bounds.expand(center + extent);
+        buildPrimitive.centroid = center;
+    }
+
+    int primitiveCount = buildPrimitives.size();
+    stats.primitiveCount = primitiveCount;
+    stats.sphereCount = spheres.size();
+
+    if (primitiveCount > 0)
+    {
+        // a binary tree with one primitive per leaf has at most 2n - 1 nodes
+        nodes.reserve(2 * primitiveCount - 1);
+        nodes.push_back(BVHNode());
+        stats.minLeafSize = primitiveCount;
+        subdivide(0, 0, primitiveCount, 1, buildPrimitives);
+
+        // number of triangles and spheres in front of every build primitive once they are reordered
+        std::vector<int> trianglesBefore(primitiveCount);
+        std::vector<int> spheresBefore(primitiveCount);
+        std::vector<CompiledTriangle> ordered;
+        std::vector<int> sphereOrder;
+        ordered.reserve(triangleCount);
+        for (int i = 0; i < primitiveCount; i++)
+        {
+            const BVHBuildPrimitive &buildPrimitive = buildPrimitives[i];
+            trianglesBefore[i] = ordered.size();
+            spheresBefore[i] = sphereOrder.size();
+            if (buildPrimitive.isSphere)
+            {
+                sphereOrder.push_back(buildPrimitive.index);
+            }
+            else
+            {
+                ordered.push_back(triangles[buildPrimitive.index]);
+            }
+        }
+        triangles.swap(ordered);
+        spheres = spheres.reordered(sphereOrder);
+
+        // pack every leaf into its own triangle blocks, leaves index the blocks and the spheres from now on.
+        // a leaf lists its triangles before its spheres, so its first sphere follows the spheres in front of it
+        for (BVHNode &node : nodes)
+        {
+            if (node.isLeaf())
+            {
+                int firstPrimitive = node.leftFirst;
+                node.leftFirst = blocks.size();
+                node.firstSphere = spheresBefore[firstPrimitive];
+                packTriangleBlocks(triangles, trianglesBefore[firstPrimitive], node.count, blocks);
+            }
+        }
+
+        double rootArea = nodes[0].bounds.surfaceArea();
+        for (const BVHNode &node : nodes)
+        {
+            double relativeArea = rootArea > 0 ? node.bounds.surfaceArea() / rootArea : 1;
+            stats.sahCost += relativeArea * (node.isLeaf() ? primitiveCost(node.count + node.sphereCount, node.sphereCount) * INTERSECTION_COST : TRAVERSAL_COST);
+        }
+    }
+
+    stats.nodeCount = nodes.size();
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = endTime - startTime;
+    stats.buildTime = elapsed.count();
+}
+
+void BVH::refit(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres)
+{
+    // children are always stored after their parent, so walking the nodes backwards
+    // updates both children of a node before the node itself
+    for (int i = nodes.size() - 1; i >= 0; i--)
+    {
+        BVHNode &node = nodes[i];
+        if (!node.isLeaf())
+        {
+            node.bounds = nodes[node.leftFirst].bounds;
+            node.bounds.expand(nodes[node.leftFirst + 1].bounds);
+            continue;
+        }
+
+        AABB bounds;
+        for (int b = node.leftFirst; b < node.leftFirst + blockCount(node.count); b++)
+        {
+            TriangleBlock &block = blocks[b];
+            for (int lane = 0; lane < SIMD_WIDTH; lane++)
+            {
+                if (block.triangleIndex[lane] < 0)
+                {
+                    continue;
+                }
+                const CompiledTriangle &triangle = triangles[block.triangleIndex[lane]];
+                block.vertexX[lane] = triangle.vertex.x;
+                block.vertexY[lane] = triangle.vertex.y;
+                block.vertexZ[lane] = triangle.vertex.z;
+                block.edge1X[lane] = triangle.edge1.x;
+                block.edge1Y[lane] = triangle.edge1.y;
+                block.edge1Z[lane] = triangle.edge1.z;
+                block.edge2X[lane] = triangle.edge2.x;
+                block.edge2Y[lane] = triangle.edge2.y;
+                block.edge2Z[lane] = triangle.edge2.z;
+                bounds.expand(triangle.vertex);
+                bounds.expand(triangle.vertex + triangle.edge1);
+                bounds.expand(triangle.vertex + triangle.edge2);
+            }
+        }
+        for (int s = node.firstSphere; s < node.firstSphere + node.sphereCount; s++)
+        {
+            Vector3 center = spheres.center(s);
+            Vector3 extent(spheres.radius[s], spheres.radius[s], spheres.radius[s]);
+            bounds.expand(center - extent);
+            bounds.expand(center + extent);
+        }
+        node.bounds = bounds;
+    }
+}
+
+void BVH::subdivide(int nodeIndex, int first, int count, int depth, std::vector<BVHBuildPrimitive> &buildPrimitives)
+{
+    AABB bounds;
+    AABB centroidBounds;
+    int sphereCount = 0;
+    for (int i = first; i < first + count; i++)
+    {
+        bounds.expand(buildPrimitives[i].bounds);
+        centroidBounds.expand(buildPrimitives[i].centroid);
+        sphereCount += buildPrimitives[i].isSphere;
+    }
+    nodes[nodeIndex].bounds = bounds;
+
+    stats.maxDepth = std::max(stats.maxDepth, depth);
+
+    auto makeLeaf = [&]()
+    {
+        // triangles first, so that each leaf covers a contiguous range of the triangles and of the spheres
+        std::stable_partition(buildPrimitives.begin() + first, buildPrimitives.begin() + first + count,
+                              [](const BVHBuildPrimitive &buildPrimitive)
+                              { return !buildPrimitive.isSphere; });
+        nodes[nodeIndex].leftFirst = first;
+        nodes[nodeIndex].count = count - sphereCount;
+        nodes[nodeIndex].sphereCount = sphereCount;
+        stats.leafCount++;
+        stats.minLeafSize = std::min(stats.minLeafSize, count);
+        stats.maxLeafSize = std::max(stats.maxLeafSize, count);
+    };
+
+    if (count <= 2 || depth >= MAX_DEPTH)
+    {
+        makeLeaf();
+        return;
+    }
+
+    // find the cheapest split plane among the bin boundaries of all three axes
+    int bestAxis = -1;
+    int bestSplit = 0;
+    double bestCost = INFINITY;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double axisMin = axisOf(centroidBounds.min, axis);
+        double axisExtent = axisOf(centroidBounds.max, axis) - axisMin;
+        if (axisExtent <= 0)
+        {
+            continue;
+        }
+
+        Bin bins[BIN_COUNT];
+        double scale = BIN_COUNT / axisExtent;
+        for (int i = first; i < first + count; i++)
+        {
+            int binIndex = std::min(BIN_COUNT - 1, (int)((axisOf(buildPrimitives[i].centroid, axis) - axisMin) * scale));
+            bins[binIndex].count++;
+            bins[binIndex].sphereCount += buildPrimitives[i].isSphere;
+            bins[binIndex].bounds.expand(buildPrimitives[i].bounds);
+        }
+
+        // sweep from both sides to get the area and count on each side of every plane
+        double leftArea[BIN_COUNT - 1];
+        int leftCount[BIN_COUNT - 1];
+        int leftSpheres[BIN_COUNT - 1];
+        double rightArea[BIN_COUNT - 1];
+        int rightCount[BIN_COUNT - 1];
+        int rightSpheres[BIN_COUNT - 1];
+
+        AABB leftBox;
+        AABB rightBox;
+        int leftSum = 0;
+        int leftSphereSum = 0;
+        int rightSum = 0;
+        int rightSphereSum = 0;
+        for (int i = 0; i < BIN_COUNT - 1; i++)
+        {
+            leftSum += bins[i].count;
+            leftSphereSum += bins[i].sphereCount;
+            leftBox.expand(bins[i].bounds);
+            leftCount[i] = leftSum;
+            leftSpheres[i] = leftSphereSum;
+            leftArea[i] = leftBox.surfaceArea();
+
+            rightSum += bins[BIN_COUNT - 1 - i].count;
+            rightSphereSum += bins[BIN_COUNT - 1 - i].sphereCount;
+            rightBox.expand(bins[BIN_COUNT - 1 - i].bounds);
+            rightCount[BIN_COUNT - 2 - i] = rightSum;
+            rightSpheres[BIN_COUNT - 2 - i] = rightSphereSum;
+            rightArea[BIN_COUNT - 2 - i] = rightBox.surfaceArea();
+        }
+
+        for (int i = 0; i < BIN_COUNT - 1; i++)
+        {
+            if (leftCount[i] == 0 || rightCount[i] == 0)
+            {
+                continue;
+            }
+            double cost = leftArea[i] * primitiveCost(leftCount[i], leftSpheres[i]) + rightArea[i] * primitiveCost(rightCount[i], rightSpheres[i]);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i + 1;
+            }
+        }
+    }
+
+    // all centroids coincide, nothing left to split on
+    if (bestAxis == -1)
+    {
+        makeLeaf();
+        return;
+    }
+
+    double nodeArea = bounds.surfaceArea();
+    double splitCost = TRAVERSAL_COST + (nodeArea > 0 ? INTERSECTION_COST * bestCost / nodeArea : INFINITY);
+    double leafCost = INTERSECTION_COST * primitiveCost(count, sphereCount);
+    if (splitCost >= leafCost && count <= MAX_LEAF_SIZE)
+    {
+        makeLeaf();
+        return;
+    }
+
+    double axisMin = axisOf(centroidBounds.min, bestAxis);
+    double scale = BIN_COUNT / (axisOf(centroidBounds.max, bestAxis) - axisMin);
+    auto middle = std::partition(buildPrimitives.begin() + first, buildPrimitives.begin() + first + count,
+                                 [&](const BVHBuildPrimitive &buildPrimitive)
+                                 {
+                                     int binIndex = std::min(BIN_COUNT - 1, (int)((axisOf(buildPrimitive.centroid, bestAxis) - axisMin) * scale));
+                                     return binIndex < bestSplit;
+                                 });
+    int leftCount = middle - (buildPrimitives.begin() + first);
+
+    int leftIndex = nodes.size();
+    nodes.push_back(BVHNode());
+    nodes.push_back(BVHNode());
+    nodes[nodeIndex].leftFirst = leftIndex;
+    nodes[nodeIndex].count = 0;
+
+    subdivide(leftIndex, first, leftCount, depth + 1, buildPrimitives);
+    subdivide(leftIndex + 1, first + leftCount, count - leftCount, depth + 1, buildPrimitives);
+}
+
+// the traversals are free functions so that they can be compiled once per instruction set,
+// the members only forward to them
+namespace
+{
+    RT_MULTIVERSION Hit traverseClosest(const BVH &bvh, const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, const Ray &ray, Real tMax)
+    {
+        const std::vector<BVHNode> &nodes = bvh.nodes;
+        const std::vector<TriangleBlock> &blocks = bvh.blocks;
+
+        Hit closestHit;
+        closestHit.isHit = false;
+
+        if (nodes.empty())
+        {
+            return closestHit;
+        }
+
+        const Vector3 &origin = ray.getOrigin();
+        const Vector3 &direction = ray.getDirection();
+        Vector3 invDirection(1 / direction.x, 1 / direction.y, 1 / direction.z);
+
+        SimdRay simdRay(ray);
+        float tClosest = tMax;
+        int closestTriangle = -1;
+        // at most one of closestTriangle and closestSphere is set, tSphere keeps the sphere distance in full precision
+        int closestSphere = -1;
+        Real tSphere = INFINITY;
+        if (nodes[0].bounds.intersect(origin, invDirection, tClosest) == INFINITY)
+        {
+            return closestHit;
+        }
+
+        int stack[MAX_DEPTH];
+        Real stackDistance[MAX_DEPTH];
+        int stackSize = 0;
+        int nodeIndex = 0;
+        // counted locally and added to the thread counters once per ray
+        int nodeVisits = 0;
+        int blockTests = 0;
+        int sphereTests = 0;
+
+        while (true)
+        {
+            const BVHNode &node = nodes[nodeIndex];
+            bool descended = false;
+            nodeVisits++;
+
+            if (node.isLeaf())
+            {
+                int lastBlock = node.leftFirst + blockCount(node.count);
+                blockTests += lastBlock - node.leftFirst;
+                for (int i = node.leftFirst; i < lastBlock; i++)
+                {
+                    if (intersectTriangleBlock(simdRay, blocks[i], tClosest, closestTriangle))
+                    {
+                        closestSphere = -1;
+                    }
+                }
+
+                if (node.sphereCount > 0)
+                {
+                    sphereTests += node.sphereCount;
+                    Real t;
+                    int sphere = intersectSpheres(spheres, node.firstSphere, node.sphereCount, ray, tClosest, t);
+                    if (sphere != -1)
+                    {
+                        closestSphere = sphere;
+                        closestTriangle = -1;
+                        tSphere = t;
+                        tClosest = t;
+                    }
+                }
+            }
+            else
+            {
+                // visit the nearer child first and keep the other one for later
+                int nearIndex = node.leftFirst;
+                int farIndex = node.leftFirst + 1;
+                Real tNear = nodes[nearIndex].bounds.intersect(origin, invDirection, tClosest);
+                Real tFar = nodes[farIndex].bounds.intersect(origin, invDirection, tClosest);
+                if (tFar < tNear)
+                {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(tNear, tFar);
+                }
+
+                if (tNear != INFINITY)
+                {
+                    if (tFar != INFINITY)
+                    {
+                        stack[stackSize] = farIndex;
+                        stackDistance[stackSize] = tFar;
+                        stackSize++;
+                    }
+                    nodeIndex = nearIndex;
+                    descended = true;
+                }
+            }
+
+            if (!descended)
+            {
+                // skip subtrees that are farther than a hit found after they were pushed
+                while (stackSize > 0 && stackDistance[stackSize - 1] >= tClosest)
+                {
+                    stackSize--;
+                }
+                if (stackSize == 0)
+                {
+                    break;
+                }
+                nodeIndex = stack[--stackSize];
+            }
+        }
+
+        threadRayCounters.nodeVisits += nodeVisits;
+        threadRayCounters.triangleTests += (uint64_t)blockTests * SIMD_WIDTH;
+        threadRayCounters.sphereTests += sphereTests;
+
+        if (closestTriangle != -1)
+        {
+            closestHit = makeTriangleHit(ray, triangles[closestTriangle], tClosest);
+        }
+        else if (closestSphere != -1)
+        {
+            closestHit = makeSphereHit(ray, spheres, closestSphere, tSphere);
+        }
+
+        return closestHit;
+    }
+
+    RT_MULTIVERSION bool traverseAny(const BVH &bvh, const SphereArray &spheres, const Ray &ray, Real tMax)
+    {
+        const std::vector<BVHNode> &nodes = bvh.nodes;
+        const std::vector<TriangleBlock> &blocks = bvh.blocks;
+
+        if (nodes.empty())
+        {
+            return false;
+        }
+
+        const Vector3 &origin = ray.getOrigin();
+        const Vector3 &direction = ray.getDirection();
+        Vector3 invDirection(1 / direction.x, 1 / direction.y, 1 / direction.z);
+
+        SimdRay simdRay(ray);
+        int stack[MAX_DEPTH + 1];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        int nodeVisits = 0;
+        int blockTests = 0;
+        int sphereTests = 0;
+        bool hit = false;
+
+        // child order does not matter, the first occluder found ends the search
+        while (stackSize > 0 && !hit)
+        {
+            const BVHNode &node = nodes[stack[--stackSize]];
+            nodeVisits++;
+            if (node.bounds.intersect(origin, invDirection, tMax) == INFINITY)
+            {
+                continue;
+            }
+
+            if (node.isLeaf())
+            {
+                int lastBlock = node.leftFirst + blockCount(node.count);
+                for (int i = node.leftFirst; i < lastBlock; i++)
+                {
+                    blockTests++;
+                    if (occludedByTriangleBlock(simdRay, blocks[i], tMax))
+                    {
+                        hit = true;
+                        break;
+                    }
+                }
+
+                if (!hit && node.sphereCount > 0)
+                {
+                    sphereTests += node.sphereCount;
+                    hit = occludedBySpheres(spheres, node.firstSphere, node.sphereCount, ray, tMax);
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.leftFirst + 1;
+                stack[stackSize++] = node.leftFirst;
+            }
+        }
+
+        threadRayCounters.nodeVisits += nodeVisits;
+        threadRayCounters.triangleTests += (uint64_t)blockTests * SIMD_WIDTH;
+        threadRayCounters.sphereTests += sphereTests;
+
+        return hit;
+    }
+}
+
+// packet traversal, see RayPacket.h
+namespace
+{
+    Real axisValue(const Vector3 &v, int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    // lane wise std::fmin and std::fmax, a NaN from 0 * INFINITY is ignored the same way
+    void laneMin(const PacketFloats &a, const PacketFloats &b, PacketFloats &result)
+    {
+        result = (a < b) | (b != b) ? a : b;
+    }
+
+    void laneMax(const PacketFloats &a, const PacketFloats &b, PacketFloats &result)
+    {
+        result = (a > b) | (b != b) ? a : b;
+    }
+
+    // active lanes of group g whose ray enters the box before its closest hit, the test of AABB::intersect
+    void groupEntersBox(const RayPacket &packet, int g, const AABB &box, PacketInts &mask)
+    {
+        PacketFloats t1;
+        PacketFloats t2;
+        PacketFloats tNear;
+        PacketFloats tFar;
+        PacketFloats axisNear;
+        PacketFloats axisFar;
+
+        t1 = ((float)box.min.x - packet.originX[g]) * packet.inverseX[g];
+        t2 = ((float)box.max.x - packet.originX[g]) * packet.inverseX[g];
+        laneMin(t1, t2, tNear);
+        laneMax(t1, t2, tFar);
+
+        t1 = ((float)box.min.y - packet.originY[g]) * packet.inverseY[g];
+        t2 = ((float)box.max.y - packet.originY[g]) * packet.inverseY[g];
+        laneMin(t1, t2, axisNear);
+        laneMax(t1, t2, axisFar);
+        laneMax(tNear, axisNear, tNear);
+        laneMin(tFar, axisFar, tFar);
+
+        t1 = ((float)box.min.z - packet.originZ[g]) * packet.inverseZ[g];
+        t2 = ((float)box.max.z - packet.originZ[g]) * packet.inverseZ[g];
+        laneMin(t1, t2, axisNear);
+        laneMax(t1, t2, axisFar);
+        laneMax(tNear, axisNear, tNear);
+        laneMin(tFar, axisFar, tFar);
+
+        mask = packet.active[g] & (tFar >= tNear) & (tFar > 0.0f) & (tNear < packet.t[g]);
+    }
+
+    // range of (plane - origin) * inverse over the origins and inverse directions of a packet.
+    // the products are rounded like the per ray ones, rounding keeps their order so the range stays conservative
+    void distanceRange(Real plane, Real originMin, Real originMax, Real inverseMin, Real inverseMax, Real &low, Real &high)
+    {
+        Real a = (plane - originMax) * inverseMin;
+        Real b = (plane - originMax) * inverseMax;
+        Real c = (plane - originMin) * inverseMin;
+        Real d = (plane - originMin) * inverseMax;
+        low = std::min(std::min(a, b), std::min(c, d));
+        high = std::max(std::max(a, b), std::max(c, d));
+    }
+
+    // one interval test for the whole packet, true only when none of its rays can enter the box
+    bool packetMissesBox(const RayPacket &packet, const AABB &box)
+    {
+        if (!packet.coherent)
+        {
+            return false;
+        }
+
+        Real tNear = -INFINITY;
+        Real tFar = INFINITY;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Real originMin = axisValue(packet.originMin, axis);
+            Real originMax = axisValue(packet.originMax, axis);
+            Real inverseMin = axisValue(packet.inverseMin, axis);
+            Real inverseMax = axisValue(packet.inverseMax, axis);
+
+            // every ray goes the same way along the axis, entering through one plane and leaving through the other
+            bool positive = inverseMin > 0;
+            Real entry = positive ? axisValue(box.min, axis) : axisValue(box.max, axis);
+            Real exit = positive ? axisValue(box.max, axis) : axisValue(box.min, axis);
+
+            Real low;
+            Real high;
+            distanceRange(entry, originMin, originMax, inverseMin, inverseMax, low, high);
+            tNear = std::max(tNear, low);
+            distanceRange(exit, originMin, originMax, inverseMin, inverseMax, low, high);
+            tFar = std::min(tFar, high);
+        }
+
+        return tNear > tFar || tFar <= 0 || tNear >= packet.tMax;
+    }
+
+    RT_MULTIVERSION void traversePacket(const BVH &bvh, const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, RayPacket &packet)
+    {
+        const std::vector<BVHNode> &nodes = bvh.nodes;
+        const std::vector<TriangleBlock> &blocks = bvh.blocks;
+
+        if (nodes.empty())
+        {
+            return;
+        }
+
+        // every stack entry keeps the first group that can still enter it, the groups before it missed an ancestor
+        int stack[MAX_DEPTH];
+        int stackFirstGroup[MAX_DEPTH];
+        int stackSize = 0;
+        int nodeIndex = 0;
+        int firstGroup = 0;
+        int nodeVisits = 0;
+        int groupTests = 0;
+        int sphereTests = 0;
+
+        while (true)
+        {
+            const BVHNode &node = nodes[nodeIndex];
+            bool descended = false;
+            nodeVisits++;
+
+            PacketInts mask = {};
+            if (!packetMissesBox(packet, node.bounds))
+            {
+                for (; firstGroup < PACKET_GROUPS; firstGroup++)
+                {
+                    groupEntersBox(packet, firstGroup, node.bounds, mask);
+                    if (anyRay(mask))
+                    {
+                        break;
+                    }
+                }
+            }
+
+            if (firstGroup < PACKET_GROUPS && anyRay(mask))
+            {
+                if (node.isLeaf())
+                {
+                    // the triangles of a leaf are contiguous, its first block starts with the first of them
+                    int firstTriangle = node.count > 0 ? blocks[node.leftFirst].triangleIndex[0] : 0;
+                    bool hit = false;
+                    for (int g = firstGroup; g < PACKET_GROUPS; g++)
+                    {
+                        if (g > firstGroup)
+                        {
+                            groupEntersBox(packet, g, node.bounds, mask);
+                            if (!anyRay(mask))
+                            {
+                                continue;
+                            }
+                        }
+
+                        groupTests += node.count;
+                        for (int i = firstTriangle; i < firstTriangle + node.count; i++)
+                        {
+                            hit |= intersectTriangleGroup(packet, g, mask, triangles[i], i);
+                        }
+
+                        for (int lane = 0; node.sphereCount > 0 && lane < PACKET_LANES; lane++)
+                        {
+                            if (!mask[lane])
+                            {
+                                continue;
+                            }
+                            sphereTests += node.sphereCount;
+                            Real t;
+                            int sphere = intersectSpheres(spheres, node.firstSphere, node.sphereCount, packet.rays[g * PACKET_LANES + lane], packet.t[g][lane], t);
+                            if (sphere != -1)
+                            {
+                                packet.t[g][lane] = t;
+                                packet.primitive[g][lane] = -2 - sphere;
+                                hit = true;
+                            }
+                        }
+                    }
+
+                    if (hit)
+                    {
+                        packet.updateTMax();
+                    }
+                }
+                else
+                {
+                    // visit the child the first entering ray meets first
+                    int lane = 0;
+                    while (!mask[lane])
+                    {
+                        lane++;
+                    }
+                    const Ray &ray = packet.rays[firstGroup * PACKET_LANES + lane];
+                    Vector3 invDirection(packet.inverseX[firstGroup][lane], packet.inverseY[firstGroup][lane], packet.inverseZ[firstGroup][lane]);
+
+                    int nearIndex = node.leftFirst;
+                    int farIndex = node.leftFirst + 1;
+                    Real tNear = nodes[nearIndex].bounds.intersect(ray.getOrigin(), invDirection, INFINITY);
+                    Real tFar = nodes[farIndex].bounds.intersect(ray.getOrigin(), invDirection, INFINITY);
+                    if (tFar < tNear)
+                    {
+                        std::swap(nearIndex, farIndex);
+                    }
+
+                    stack[stackSize] = farIndex;
+                    stackFirstGroup[stackSize] = firstGroup;
+                    stackSize++;
+                    nodeIndex = nearIndex;
+                    descended = true;
+                }
+            }
+
+            if (!descended)
+            {
+                if (stackSize == 0)
+                {
+                    break;
+                }
+                stackSize--;
+                nodeIndex = stack[stackSize];
+                firstGroup = stackFirstGroup[stackSize];
+            }
+        }
+
+        threadRayCounters.nodeVisits += nodeVisits;
+        threadRayCounters.triangleTests += (uint64_t)groupTests * PACKET_LANES;
+        threadRayCounters.sphereTests += sphereTests;
+    }
+}
+
+Hit BVH::intersect(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, const Ray &ray, Real tMax) const
+{
+    return traverseClosest(*this, triangles, spheres, ray, tMax);
+}
+
+void BVH::intersect(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, RayPacket &packet) const
+{
+    traversePacket(*this, triangles, spheres, packet);
+}
+
+bool BVH::occluded(const SphereArray &spheres, const Ray &ray, Real tMax) const
+{
+    return traverseAny(*this, spheres, ray, tMax);
+}
+
+bool BVH::overlaps(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, const ShadowVolume &volume) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    int stack[MAX_DEPTH + 1];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    int nodeVisits = 0;
+    bool overlap = false;
+
+    while (stackSize > 0 && !overlap)
+    {
+        const BVHNode &node = nodes[stack[--stackSize]];
+        nodeVisits++;
+        if (!volume.overlaps(node.bounds))
+        {
+            continue;
+        }
+
+        if (!node.isLeaf())
+        {
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+            continue;
+        }
+
+        // the primitives of a leaf are tested on their own bounds, which are much tighter than the leaf
+        for (int b = node.leftFirst; b < node.leftFirst + blockCount(node.count) && !overlap; b++)
+        {
+            for (int lane = 0; lane < SIMD_WIDTH && !overlap; lane++)
+            {
+                int index = blocks[b].triangleIndex[lane];
+                if (index < 0)
+                {
+                    continue;
+                }
+                const CompiledTriangle &triangle = triangles[index];
+                AABB bounds;
+                bounds.expand(triangle.vertex);
+                bounds.expand(triangle.vertex + triangle.edge1);
+                bounds.expand(triangle.vertex + triangle.edge2);
+                overlap = volume.overlaps(bounds);
+            }
+        }
+        for (int s = node.firstSphere; s < node.firstSphere + node.sphereCount && !overlap; s++)
+        {
+            Vector3 center = spheres.center(s);
+            Vector3 extent(spheres.radius[s], spheres.radius[s], spheres.radius[s]);
+            AABB bounds;
+            bounds.expand(center - extent);
+            bounds.expand(center + extent);
+            overlap = volume.overlaps(bounds);
+        }
+    }
+
+    threadRayCounters.nodeVisits += nodeVisits;
+    return overlap;
+}
@@ -0,0 +1,206 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "Intersection.h"
+#include "TriangleSimd.h"
+#include "SphereArray.h"
+
+class AABB {
+public:
+    Vector3 min;
+    Vector3 max;
+
+    AABB() : min(INFINITY, INFINITY, INFINITY), max(-INFINITY, -INFINITY, -INFINITY) {}
+
+    void expand(const Vector3 &p)
+    {
+        min = Vector3(std::fmin(min.x, p.x), std::fmin(min.y, p.y), std::fmin(min.z, p.z));
+        max = Vector3(std::fmax(max.x, p.x), std::fmax(max.y, p.y), std::fmax(max.z, p.z));
+    }
+
+    void expand(const AABB &box)
+    {
+        min = Vector3(std::fmin(min.x, box.min.x), std::fmin(min.y, box.min.y), std::fmin(min.z, box.min.z));
+        max = Vector3(std::fmax(max.x, box.max.x), std::fmax(max.y, box.max.y), std::fmax(max.z, box.max.z));
+    }
+
+    double surfaceArea() const
+    {
+        Vector3 d = max - min;
+        if (d.x < 0 || d.y < 0 || d.z < 0)
+        {
+            return 0;
+        }
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // slab test, returns the entry distance or INFINITY when the box is missed
+    Real intersect(const Vector3 &origin, const Vector3 &invDirection, Real tMax) const
+    {
+        Real tx1 = (min.x - origin.x) * invDirection.x;
+        Real tx2 = (max.x - origin.x) * invDirection.x;
+        Real tNear = std::fmin(tx1, tx2);
+        Real tFar = std::fmax(tx1, tx2);
+
+        Real ty1 = (min.y - origin.y) * invDirection.y;
+        Real ty2 = (max.y - origin.y) * invDirection.y;
+        tNear = std::fmax(tNear, std::fmin(ty1, ty2));
+        tFar = std::fmin(tFar, std::fmax(ty1, ty2));
+
+        Real tz1 = (min.z - origin.z) * invDirection.z;
+        Real tz2 = (max.z - origin.z) * invDirection.z;
+        tNear = std::fmax(tNear, std::fmin(tz1, tz2));
+        tFar = std::fmin(tFar, std::fmax(tz1, tz2));
+
+        if (tFar >= tNear && tFar > 0 && tNear < tMax)
+        {
+            return tNear;
+        }
+        return INFINITY;
+    }
+};
+
+// tetrahedron covering every segment from an apex to a point of a triangle, the volume the shadow rays
+// towards an area light sweep. boxes are only tested on the box axes and the face normals of the tetrahedron,
+// so a box reported disjoint never touches the volume, while a box reported overlapping may still miss it
+class ShadowVolume {
+public:
+    ShadowVolume(const Vector3 &apex, const Vector3 &a, const Vector3 &b, const Vector3 &c)
+    {
+        const Vector3 corners[4] = {apex, a, b, c};
+        const int faces[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
+        for (const Vector3 &corner : corners)
+        {
+            bounds.expand(corner);
+        }
+        for (int f = 0; f < 4; f++)
+        {
+            const Vector3 &origin = corners[faces[f][0]];
+            normals[f] = cross(corners[faces[f][1]] - origin, corners[faces[f][2]] - origin);
+            minimum[f] = INFINITY;
+            maximum[f] = -INFINITY;
+            for (const Vector3 &corner : corners)
+            {
+                Real projection = dot(normals[f], corner);
+                minimum[f] = std::fmin(minimum[f], projection);
+                maximum[f] = std::fmax(maximum[f], projection);
+            }
+        }
+
+        // boxes are grown by a little more than the rounding error of the intersection kernels
+        Real scale = std::fmax(std::fmax(std::fabs(bounds.min.x), std::fabs(bounds.max.x)),
+                               std::fmax(std::fmax(std::fabs(bounds.min.y), std::fabs(bounds.max.y)),
+                                         std::fmax(std::fabs(bounds.min.z), std::fabs(bounds.max.z))));
+        tolerance = Real(1e-5) * (scale + 1);
+    }
+
+    bool overlaps(const AABB &box) const
+    {
+        Vector3 padding(tolerance, tolerance, tolerance);
+        Vector3 low = box.min - padding;
+        Vector3 high = box.max + padding;
+        if (low.x > bounds.max.x || high.x < bounds.min.x || low.y > bounds.max.y || high.y < bounds.min.y ||
+            low.z > bounds.max.z || high.z < bounds.min.z)
+        {
+            return false;
+        }
+
+        Vector3 center = Real(0.5) * (low + high);
+        Vector3 extent = Real(0.5) * (high - low);
+        for (int f = 0; f < 4; f++)
+        {
+            const Vector3 &n = normals[f];
+            Real radius = std::fabs(n.x) * extent.x + std::fabs(n.y) * extent.y + std::fabs(n.z) * extent.z;
+            Real projection = dot(n, center);
+            if (projection + radius < minimum[f] || projection - radius > maximum[f])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    AABB bounds;
+    Vector3 normals[4];
+    Real minimum[4];
+    Real maximum[4];
+    Real tolerance;
+};
+
+// interior nodes store the index of their left child (the right child follows it),
+// leaves store the index of their first triangle block and their triangle count,
+// and the index of their first sphere and their sphere count. one of the counts is non-zero
+class BVHNode {
+public:
+    AABB bounds;
+    int leftFirst;
+    int count = 0;
+    int firstSphere = 0;
+    int sphereCount = 0;
+
+    bool isLeaf() const
+    {
+        return count > 0 || sphereCount > 0;
+    }
+};
+
+// per primitive data only needed while building
+class BVHBuildPrimitive {
+public:
+    // index into the triangles, or into the spheres when isSphere is set
+    int index;
+    bool isSphere;
+    AABB bounds;
+    Vector3 centroid;
+};
+
+class RayPacket;
+
+class BVHStats {
+public:
+    double buildTime = 0;
+    int primitiveCount = 0;
+    int sphereCount = 0;
+    int nodeCount = 0;
+    int leafCount = 0;
+    int maxDepth = 0;
+    int minLeafSize = 0;
+    int maxLeafSize = 0;
+    double sahCost = 0;
+};
+
+class BVH {
+public:
+    std::vector<BVHNode> nodes;
+    std::vector<TriangleBlock> blocks;
+    BVHStats stats;
+
+    // builds one hierarchy over the triangles and spheres using binned SAH splits. both are reordered so
+    // that every leaf covers a contiguous range of each, its triangles are packed into its own blocks
+    void build(std::vector<CompiledTriangle> &triangles, SphereArray &spheres);
+
+    // moves the hierarchy built over the triangles and spheres to their current positions. the tree and the
+    // order of the primitives are kept, only the blocks and the node bounds are updated, so this is much
+    // cheaper than a build but the tree fits the primitives worse the farther they move from where it was built
+    void refit(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres);
+
+    // closest hit along the ray with t < tMax, isHit is false when nothing is hit
+    Hit intersect(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, const Ray &ray, Real tMax = INFINITY) const;
+
+    // closest hits of every active ray of the packet, left in packet.t and packet.primitive
+    void intersect(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, RayPacket &packet) const;
+
+    // any hit with t < tMax, stops at the first one found
+    bool occluded(const SphereArray &spheres, const Ray &ray, Real tMax) const;
+
+    // true when the bounds of any triangle or sphere overlap the volume. false proves that no ray
+    // running inside the volume hits anything, stops at the first overlap found
+    bool overlaps(const std::vector<CompiledTriangle> &triangles, const SphereArray &spheres, const ShadowVolume &volume) const;
+
+private:
+    void subdivide(int nodeIndex, int first, int count, int depth, std::vector<BVHBuildPrimitive> &buildPrimitives);
+};
+
+#endif // BVH_H
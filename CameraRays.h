@@ -0,0 +1,130 @@
+#ifndef CAMERARAYS_H
+#define CAMERARAYS_H
+
+#include <cmath>
+#include "SceneXmlModel.h"
+#include "Ray.h"
+
+#if defined(__SSE2__) && !defined(RT_DOUBLE)
+#include <xmmintrin.h>
+#endif
+
+// primary ray generation, cameraSetup has to run once before rays are calculated for a camera
+
+inline void cameraSetup(Camera &camera)
+{
+    int width = camera.imageResolution.nx;
+    int height = camera.imageResolution.ny;
+
+    // m = e + (gaze* distance)
+    Vector3 m = camera.position + (camera.gaze * camera.nearDistance);
+    Vector3 w = -1 * camera.gaze;
+
+    // q = m + (left * u) + (top * v)
+    camera.v = camera.up;
+    camera.u = cross(camera.v, w);
+    camera.q = m + camera.nearPlane.left * camera.u + camera.nearPlane.top * camera.v;
+
+    // the pixel center (i, j) is at q + (i + 0.5) stepU + (j + 0.5) stepV, stepV points down the image
+    camera.pixelStepU = ((camera.nearPlane.right - camera.nearPlane.left) / width) * camera.u;
+    camera.pixelStepV = (-(camera.nearPlane.top - camera.nearPlane.bottom) / height) * camera.v;
+    camera.firstPixel = camera.q - camera.position + Real(0.5) * camera.pixelStepU + Real(0.5) * camera.pixelStepV;
+}
+
+// ray through the point (x, y) of the image plane, measured in pixels from the top left corner
+inline Ray calculateRay(const Camera &camera, Real x, Real y)
+{
+    // S = q + SuU - SvV
+    Real Su = (camera.nearPlane.right - camera.nearPlane.left) * x / camera.imageResolution.nx;
+    Real Sv = (camera.nearPlane.top - camera.nearPlane.bottom) * y / camera.imageResolution.ny;
+    Vector3 SuU = Su * camera.u;
+    Vector3 SvV = Sv * camera.v;
+
+    Vector3 S = camera.q + SuU - SvV;
+
+    // r(t) = e + (s-e)t
+    Vector3 direction = S - camera.position;
+    direction = direction.normalize();
+
+    Ray ray = Ray(camera.position, direction);
+    return ray;
+}
+
+// ray through the center of pixel (i, j)
+inline Ray calculateRay(const Camera &camera, int i, int j)
+{
+    return calculateRay(camera, i + Real(0.5), j + Real(0.5));
+}
+
+// the primary rays of consecutive pixels of one row, as arrays the later stages read in bulk
+const int RAY_BATCH_SIZE = 64;
+
+class alignas(16) CameraRayBatch {
+public:
+    Real originX[RAY_BATCH_SIZE];
+    Real originY[RAY_BATCH_SIZE];
+    Real originZ[RAY_BATCH_SIZE];
+    Real directionX[RAY_BATCH_SIZE];
+    Real directionY[RAY_BATCH_SIZE];
+    Real directionZ[RAY_BATCH_SIZE];
+    int count = 0;
+
+    Ray ray(int k) const
+    {
+        return Ray(Vector3(originX[k], originY[k], originZ[k]), Vector3(directionX[k], directionY[k], directionZ[k]));
+    }
+};
+
+// fills batch with the rays through the centers of pixels (i, j) to (i + count - 1, j), count <= RAY_BATCH_SIZE.
+// the directions step along the row from the first pixel of the row, one multiply-add per pixel instead of
+// the divisions of calculateRay, and are normalized four at a time with an approximate reciprocal square root
+// refined by one Newton-Raphson step. they agree with calculateRay to a few units in the last place
+inline void generateRowRays(const Camera &camera, int i, int j, int count, CameraRayBatch &batch)
+{
+    batch.count = count;
+
+    // the lanes past count are filled too so the normalization works on whole groups of four
+    int lanes = (count + 3) & ~3;
+    Vector3 rowStart = camera.firstPixel + Real(j) * camera.pixelStepV;
+    for (int k = 0; k < lanes; k++)
+    {
+        Real x = Real(i + k);
+        batch.originX[k] = camera.position.x;
+        batch.originY[k] = camera.position.y;
+        batch.originZ[k] = camera.position.z;
+        batch.directionX[k] = rowStart.x + x * camera.pixelStepU.x;
+        batch.directionY[k] = rowStart.y + x * camera.pixelStepU.y;
+        batch.directionZ[k] = rowStart.z + x * camera.pixelStepU.z;
+    }
+
+#if defined(__SSE2__) && !defined(RT_DOUBLE)
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 threeHalves = _mm_set1_ps(1.5f);
+    for (int k = 0; k < lanes; k += 4)
+    {
+        __m128 dx = _mm_load_ps(batch.directionX + k);
+        __m128 dy = _mm_load_ps(batch.directionY + k);
+        __m128 dz = _mm_load_ps(batch.directionZ + k);
+        __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        // r = r (1.5 - 0.5 l r^2) takes the 12 bit estimate to about 23 bits
+        __m128 r = _mm_rsqrt_ps(lengthSquared);
+        r = _mm_mul_ps(r, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, lengthSquared), _mm_mul_ps(r, r))));
+
+        _mm_store_ps(batch.directionX + k, _mm_mul_ps(dx, r));
+        _mm_store_ps(batch.directionY + k, _mm_mul_ps(dy, r));
+        _mm_store_ps(batch.directionZ + k, _mm_mul_ps(dz, r));
+    }
+#else
+    for (int k = 0; k < count; k++)
+    {
+        Real inverseLength = 1 / std::sqrt(batch.directionX[k] * batch.directionX[k] + batch.directionY[k] * batch.directionY[k] +
+                                           batch.directionZ[k] * batch.directionZ[k]);
+        batch.directionX[k] *= inverseLength;
+        batch.directionY[k] *= inverseLength;
+        batch.directionZ[k] *= inverseLength;
+    }
+#endif
+}
+
+#endif // CAMERARAYS_H
@@ -0,0 +1,121 @@
+#include "CompiledScene.h"
+#include <algorithm>
+
+namespace
+{
+    void addMeshTriangles(const Scene &scene, const Mesh &mesh, int meshIndex, std::vector<CompiledTriangle> &triangles)
+    {
+        for (const Face &face : mesh.faces)
+        {
+            // face indices are 1-based
+            const Vector3 &vertex1 = scene.vertexData[face.vertex1 - 1];
+            const Vector3 &vertex2 = scene.vertexData[face.vertex2 - 1];
+            const Vector3 &vertex3 = scene.vertexData[face.vertex3 - 1];
+
+            CompiledTriangle triangle;
+            triangle.vertex = vertex1;
+            triangle.edge1 = vertex2 - vertex1;
+            triangle.edge2 = vertex3 - vertex1;
+            triangle.materialId = mesh.materialId;
+            triangle.objectId = mesh.id;
+            triangle.meshIndex = meshIndex;
+            triangles.push_back(triangle);
+        }
+    }
+
+    // index in Scene::meshes of the mesh an instance places
+    int baseMeshIndex(const Scene &scene, const MeshInstance &meshInstance)
+    {
+        return std::find_if(scene.meshes.begin(), scene.meshes.end(), [&](const Mesh &m)
+                            { return m.id == meshInstance.baseMeshId; }) -
+               scene.meshes.begin();
+    }
+
+    // every mesh placed by an instance is stored once, with one bottom level BVH shared by all of its instances.
+    // where the scene defines the mesh it is placed by one more copy, with the identity transform
+    void compileInstances(const Scene &scene, InstanceBVH &instances)
+    {
+        instances = InstanceBVH();
+        std::vector<int> sceneMeshes;
+        for (const MeshInstance &meshInstance : scene.meshInstances)
+        {
+            int sceneMesh = baseMeshIndex(scene, meshInstance);
+            int meshIndex = std::find(sceneMeshes.begin(), sceneMeshes.end(), sceneMesh) - sceneMeshes.begin();
+
+            const Mesh &mesh = scene.meshes[sceneMesh];
+            if (meshIndex == (int)sceneMeshes.size())
+            {
+                sceneMeshes.push_back(sceneMesh);
+                instances.meshes.emplace_back();
+                InstancedMesh &instancedMesh = instances.meshes.back();
+                instancedMesh.meshId = mesh.id;
+                addMeshTriangles(scene, mesh, -1, instancedMesh.triangles);
+                instancedMesh.bvh.build(instancedMesh.triangles, instancedMesh.spheres);
+            }
+
+            CompiledInstance instance;
+            instance.id = meshInstance.id;
+            instance.mesh = meshIndex;
+            instance.materialId = meshInstance.materialId > 0 ? meshInstance.materialId : mesh.materialId;
+            instances.instances.push_back(instance);
+            instances.setTransform(instances.instances.size() - 1, meshInstance.transform);
+        }
+
+        for (size_t m = 0; m < sceneMeshes.size(); m++)
+        {
+            CompiledInstance instance;
+            instance.id = scene.meshes[sceneMeshes[m]].id;
+            instance.mesh = m;
+            instance.materialId = scene.meshes[sceneMeshes[m]].materialId;
+            instance.sceneMesh = sceneMeshes[m];
+            instances.instances.push_back(instance);
+            instances.setTransform(instances.instances.size() - 1, Transform());
+        }
+        instances.buildTopLevel();
+    }
+}
+
+void compileScene(const Scene &scene, CompiledScene *compiled, bool buildBVH)
+{
+    // the meshes placed by instances are only stored with the instances, see compileInstances
+    std::vector<bool> instanced(scene.meshes.size(), false);
+    for (const MeshInstance &meshInstance : scene.meshInstances)
+    {
+        instanced[baseMeshIndex(scene, meshInstance)] = true;
+    }
+
+    int triangleCount = 0;
+    for (size_t m = 0; m < scene.meshes.size(); m++)
+    {
+        triangleCount += instanced[m] ? 0 : scene.meshes[m].faces.size();
+    }
+
+    compiled->triangles.clear();
+    compiled->blocks.clear();
+    compiled->triangles.reserve(triangleCount);
+
+    for (size_t m = 0; m < scene.meshes.size(); m++)
+    {
+        if (!instanced[m])
+        {
+            addMeshTriangles(scene, scene.meshes[m], m, compiled->triangles);
+        }
+    }
+
+    compiled->spheres.clear();
+    for (const Sphere &sphere : scene.spheres)
+    {
+        compiled->spheres.add(scene.vertexData[sphere.center - 1], sphere.radius, sphere.materialId, sphere.id);
+    }
+
+    if (buildBVH)
+    {
+        compiled->bvh.build(compiled->triangles, compiled->spheres);
+    }
+    else
+    {
+        packTriangleBlocks(compiled->triangles, 0, triangleCount, compiled->blocks);
+    }
+
+    compileInstances(scene, compiled->instances);
+}
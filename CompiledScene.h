@@ -0,0 +1,35 @@
+#ifndef COMPILEDSCENE_H
+#define COMPILEDSCENE_H
+
+#include <vector>
+#include "SceneXmlModel.h"
+#include "Intersection.h"
+#include "BVH.h"
+#include "SphereArray.h"
+#include "InstanceBVH.h"
+
+// flat, render ready form of the scene geometry, built once after the xml is loaded
+class CompiledScene {
+public:
+    // every triangle of every mesh in one contiguous buffer,
+    // reordered by the BVH build so that each leaf covers a contiguous range
+    std::vector<CompiledTriangle> triangles;
+
+    // every sphere, reordered by the BVH build like the triangles
+    SphereArray spheres;
+
+    // empty when the scene is searched linearly
+    BVH bvh;
+
+    // every triangle packed for the SIMD kernel, only filled when there is no BVH
+    std::vector<TriangleBlock> blocks;
+
+    // the mesh instances over the only copy of each mesh they place, which is not in triangles. where the
+    // scene defines such a mesh it is rendered through the instances as well. always built, also when the
+    // rest of the scene has no BVH
+    InstanceBVH instances;
+};
+
+void compileScene(const Scene &scene, CompiledScene *compiled, bool buildBVH);
+
+#endif // COMPILEDSCENE_H
@@ -0,0 +1,241 @@
+#include "InstanceBVH.h"
+#include <algorithm>
+#include "RenderStats.h"
+
+namespace
+{
+    // the top level is split at the median instance, so its depth stays below log2 of the instance count + 1
+    const int TOP_LEVEL_STACK = 64;
+
+    Real centroidAxis(const AABB &bounds, int axis)
+    {
+        Vector3 centroid = (bounds.min + bounds.max) * Real(0.5);
+        return axis == 0 ? centroid.x : (axis == 1 ? centroid.y : centroid.z);
+    }
+
+    Ray objectRay(const CompiledInstance &instance, const Ray &ray)
+    {
+        return Ray(instance.worldToObject.point(ray.getOrigin()), instance.worldToObject.vector(ray.getDirection()));
+    }
+}
+
+void InstanceBVH::setTransform(int i, const Transform &objectToWorld)
+{
+    CompiledInstance &instance = instances[i];
+    instance.objectToWorld = objectToWorld;
+    instance.worldToObject = objectToWorld.inverse();
+
+    // bounds of the eight transformed corners of the mesh bounds
+    instance.bounds = AABB();
+    const std::vector<BVHNode> &meshNodes = meshes[instance.mesh].bvh.nodes;
+    if (meshNodes.empty())
+    {
+        return;
+    }
+    const AABB &meshBounds = meshNodes[0].bounds;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        Vector3 p((corner & 1) ? meshBounds.max.x : meshBounds.min.x,
+                  (corner & 2) ? meshBounds.max.y : meshBounds.min.y,
+                  (corner & 4) ? meshBounds.max.z : meshBounds.min.z);
+        instance.bounds.expand(objectToWorld.point(p));
+    }
+}
+
+void InstanceBVH::buildTopLevel()
+{
+    nodes.clear();
+    if (instances.empty())
+    {
+        return;
+    }
+
+    nodes.reserve(2 * instances.size());
+    nodes.push_back(BVHNode());
+    subdivide(0, 0, instances.size());
+}
+
+void InstanceBVH::subdivide(int nodeIndex, int first, int count)
+{
+    AABB bounds;
+    AABB centroidBounds;
+    for (int i = first; i < first + count; i++)
+    {
+        bounds.expand(instances[i].bounds);
+        centroidBounds.expand((instances[i].bounds.min + instances[i].bounds.max) * Real(0.5));
+    }
+    nodes[nodeIndex].bounds = bounds;
+
+    if (count <= 2)
+    {
+        nodes[nodeIndex].leftFirst = first;
+        nodes[nodeIndex].count = count;
+        return;
+    }
+
+    Vector3 extent = centroidBounds.max - centroidBounds.min;
+    int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+    int half = count / 2;
+    std::nth_element(instances.begin() + first, instances.begin() + first + half, instances.begin() + first + count,
+                     [axis](const CompiledInstance &a, const CompiledInstance &b)
+                     { return centroidAxis(a.bounds, axis) < centroidAxis(b.bounds, axis); });
+
+    // the children are appended after the node, nodes may reallocate so it is only accessed by index
+    int left = nodes.size();
+    nodes.push_back(BVHNode());
+    nodes.push_back(BVHNode());
+    nodes[nodeIndex].leftFirst = left;
+    nodes[nodeIndex].count = 0;
+    subdivide(left, first, half);
+    subdivide(left + 1, first + half, count - half);
+}
+
+Hit InstanceBVH::intersect(const Ray &ray, Real tMax) const
+{
+    Hit closestHit;
+    closestHit.isHit = false;
+
+    if (nodes.empty())
+    {
+        return closestHit;
+    }
+
+    const Vector3 &origin = ray.getOrigin();
+    const Vector3 &direction = ray.getDirection();
+    Vector3 invDirection(1 / direction.x, 1 / direction.y, 1 / direction.z);
+    Real tClosest = tMax;
+
+    int stack[TOP_LEVEL_STACK];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    int nodeVisits = 0;
+
+    while (stackSize > 0)
+    {
+        const BVHNode &node = nodes[stack[--stackSize]];
+        nodeVisits++;
+        if (node.bounds.intersect(origin, invDirection, tClosest) == INFINITY)
+        {
+            continue;
+        }
+
+        if (node.isLeaf())
+        {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+            {
+                const CompiledInstance &instance = instances[i];
+                const InstancedMesh &mesh = meshes[instance.mesh];
+                Hit hit = mesh.bvh.intersect(mesh.triangles, mesh.spheres, objectRay(instance, ray), tClosest);
+                if (hit.isHit)
+                {
+                    tClosest = hit.t;
+                    closestHit = hit;
+                    closestHit.pointIntersects = findIntersectionPoint(ray, hit.t);
+                    closestHit.surfaceNormal = instance.worldToObject.transposedVector(hit.surfaceNormal);
+                    closestHit.materialId = instance.materialId;
+                    closestHit.objectId = instance.id;
+                }
+            }
+        }
+        else
+        {
+            // the nearer child is pushed last so it is visited first
+            int nearIndex = node.leftFirst;
+            int farIndex = node.leftFirst + 1;
+            if (nodes[farIndex].bounds.intersect(origin, invDirection, tClosest) < nodes[nearIndex].bounds.intersect(origin, invDirection, tClosest))
+            {
+                std::swap(nearIndex, farIndex);
+            }
+            stack[stackSize++] = farIndex;
+            stack[stackSize++] = nearIndex;
+        }
+    }
+
+    threadRayCounters.nodeVisits += nodeVisits;
+    return closestHit;
+}
+
+bool InstanceBVH::occluded(const Ray &ray, Real tMax) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    const Vector3 &origin = ray.getOrigin();
+    const Vector3 &direction = ray.getDirection();
+    Vector3 invDirection(1 / direction.x, 1 / direction.y, 1 / direction.z);
+
+    int stack[TOP_LEVEL_STACK];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    int nodeVisits = 0;
+    bool hit = false;
+
+    while (stackSize > 0 && !hit)
+    {
+        const BVHNode &node = nodes[stack[--stackSize]];
+        nodeVisits++;
+        if (node.bounds.intersect(origin, invDirection, tMax) == INFINITY)
+        {
+            continue;
+        }
+
+        if (node.isLeaf())
+        {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count && !hit; i++)
+            {
+                const CompiledInstance &instance = instances[i];
+                hit = meshes[instance.mesh].bvh.occluded(meshes[instance.mesh].spheres, objectRay(instance, ray), tMax);
+            }
+        }
+        else
+        {
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+        }
+    }
+
+    threadRayCounters.nodeVisits += nodeVisits;
+    return hit;
+}
+
+bool InstanceBVH::overlaps(const ShadowVolume &volume) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    int stack[TOP_LEVEL_STACK];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    int nodeVisits = 0;
+    bool overlap = false;
+
+    while (stackSize > 0 && !overlap)
+    {
+        const BVHNode &node = nodes[stack[--stackSize]];
+        nodeVisits++;
+        if (!volume.overlaps(node.bounds))
+        {
+            continue;
+        }
+
+        if (node.isLeaf())
+        {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count && !overlap; i++)
+            {
+                overlap = volume.overlaps(instances[i].bounds);
+            }
+        }
+        else
+        {
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+        }
+    }
+
+    threadRayCounters.nodeVisits += nodeVisits;
+    return overlap;
+}
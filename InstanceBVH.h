@@ -0,0 +1,66 @@
+#ifndef INSTANCEBVH_H
+#define INSTANCEBVH_H
+
+#include <vector>
+#include "BVH.h"
+#include "Transform.h"
+
+// geometry of a mesh placed by instances, in the coordinates of the mesh and with its own bottom level BVH.
+// it is stored once however many instances place it
+class InstancedMesh {
+public:
+    int meshId;
+    std::vector<CompiledTriangle> triangles;
+    // always empty, the bottom level hierarchies only hold triangles
+    SphereArray spheres;
+    BVH bvh;
+};
+
+// one placed copy of an instanced mesh
+class CompiledInstance {
+public:
+    // id of the mesh instance, or of the mesh for the copy where the scene defines it
+    int id;
+    // index into InstanceBVH::meshes
+    int mesh;
+    // index into Scene::meshes for the copy where the scene defines the mesh, -1 for mesh instances
+    int sceneMesh = -1;
+    // material of every triangle of the copy, the override of the instance or the material of the mesh
+    int materialId;
+    Transform objectToWorld;
+    Transform worldToObject;
+    // bounds of the placed copy in the scene
+    AABB bounds;
+};
+
+// two level acceleration structure: a small top level BVH over the instances, whose leaves move the ray
+// into the coordinates of each instance and trace it through the shared bottom level BVH of its mesh.
+// the ray direction is transformed but not normalized, so distances along it are the same at both levels.
+// moving an instance only needs setTransform() and buildTopLevel()
+class InstanceBVH {
+public:
+    std::vector<InstancedMesh> meshes;
+    std::vector<CompiledInstance> instances;
+    // top level, leaves cover the instances leftFirst up to leftFirst + count
+    std::vector<BVHNode> nodes;
+
+    // places instance i, its bounds follow from the bounds of its mesh
+    void setTransform(int i, const Transform &objectToWorld);
+
+    // builds the top level over the current bounds of the instances, reordering them
+    void buildTopLevel();
+
+    // closest hit with t < tMax in scene coordinates, isHit is false when no instance is hit
+    Hit intersect(const Ray &ray, Real tMax) const;
+
+    // any hit with t < tMax
+    bool occluded(const Ray &ray, Real tMax) const;
+
+    // true when the bounds of any placed copy overlap the volume
+    bool overlaps(const ShadowVolume &volume) const;
+
+private:
+    void subdivide(int nodeIndex, int first, int count);
+};
+
+#endif // INSTANCEBVH_H
@@ -0,0 +1,141 @@
+#ifndef INTERSECTION_H
+#define INTERSECTION_H
+
+#include <cmath>
+#include <utility>
+#include "Vector3.h"
+#include "Ray.h"
+
+template <typename T>
+class HitT
+{
+public:
+    bool isHit;
+    Vector3T<T> surfaceNormal;
+    int materialId;
+    T t;
+    Vector3T<T> pointIntersects;
+    int objectId;
+};
+
+typedef HitT<Real> Hit;
+
+// triangle prepared for intersection tests, the edges are computed once when the scene is compiled
+template <typename T>
+class alignas(32) CompiledTriangleT {
+public:
+    Vector3T<T> vertex;
+    Vector3T<T> edge1;
+    Vector3T<T> edge2;
+    int materialId;
+    int objectId;
+    // index in Scene::meshes of the mesh the triangle was compiled from, -1 in the meshes of instances
+    int meshIndex;
+};
+
+typedef CompiledTriangleT<Real> CompiledTriangle;
+
+template <typename T>
+inline Vector3T<T> findIntersectionPoint(const RayT<T> &ray, T t)
+{
+    Vector3T<T> result;
+    const Vector3T<T> &rayOrigin = ray.getOrigin();
+    const Vector3T<T> &rayDirection = ray.getDirection();
+
+    result.x = rayOrigin.x + t * rayDirection.x;
+    result.y = rayOrigin.y + t * rayDirection.y;
+    result.z = rayOrigin.z + t * rayDirection.z;
+
+    return result;
+}
+
+template <typename T>
+inline HitT<T> triangleIntersection(const RayT<T> &ray, const CompiledTriangleT<T> &triangle, T tMax)
+{
+    // determine if the ray intersects with the triangle using baricentric coordinates
+    // only hits with 0.00001 < t < tMax are reported
+    HitT<T> hit;
+    hit.isHit = false;
+
+    // edge vectors
+    const Vector3T<T> &a = triangle.vertex;
+    const Vector3T<T> &e1 = triangle.edge1;
+    const Vector3T<T> &e2 = triangle.edge2;
+
+    Vector3T<T> h = cross(ray.getDirection(), e2);
+    T a_ = dot(e1, h);
+
+    if (a_ > T(-0.00001) && a_ < T(0.00001))
+    {
+        return hit;
+    }
+
+    T f = 1 / a_;
+    Vector3T<T> s = ray.getOrigin() - a;
+    T u = f * dot(s, h);
+
+    if (u < 0 || u > 1)
+    {
+        return hit;
+    }
+    Vector3T<T> q = cross(s, e1);
+    T v = f * dot(ray.getDirection(), q);
+
+    if (v < 0 || u + v > 1)
+    {
+        return hit;
+    }
+
+    T t = f * dot(e2, q);
+
+    if (t > T(0.00001) && t < tMax)
+    {
+        hit.isHit = true;
+        hit.t = t;
+        hit.pointIntersects = findIntersectionPoint(ray, t);
+        hit.surfaceNormal = cross(e1, e2);
+        hit.materialId = triangle.materialId;
+        hit.objectId = triangle.objectId;
+    }
+
+    return hit;
+}
+
+// distance to the nearest hit with 0.00001 < t < tMax, INFINITY when the sphere is missed
+template <typename T>
+inline T sphereIntersection(const RayT<T> &ray, const Vector3T<T> &center, T radius, T tMax)
+{
+    // with f = origin - center the hits solve a t^2 + 2 b t + c = 0
+    const Vector3T<T> &d = ray.getDirection();
+    Vector3T<T> f = ray.getOrigin() - center;
+    T a = dot(d, d);
+    T b = dot(f, d);
+    T c = dot(f, f) - radius * radius;
+
+    // b^2 - a c written as a (r^2 - |l|^2), l is the offset of the closest point of the line from the center.
+    // unlike b^2 - a c it does not cancel to noise for small spheres far from the origin
+    Vector3T<T> l = f - (b / a) * d;
+    T discriminant = a * (radius * radius - dot(l, l));
+    if (discriminant < 0)
+    {
+        return INFINITY;
+    }
+
+    // q has the sign of -b, the roots c / q and q / a never subtract nearly equal values
+    T q = -(b + std::copysign(std::sqrt(discriminant), b));
+    T t0 = c / q;
+    T t1 = q / a;
+    if (t0 > t1)
+    {
+        std::swap(t0, t1);
+    }
+
+    T t = t0 > T(0.00001) ? t0 : t1;
+    if (t > T(0.00001) && t < tMax)
+    {
+        return t;
+    }
+    return INFINITY;
+}
+
+#endif // INTERSECTION_H
@@ -0,0 +1,101 @@
+#ifndef NUMBERPARSER_H
+#define NUMBERPARSER_H
+
+#include <charconv>
+#include <cstring>
+#include <vector>
+#include "SceneXmlModel.h"
+
+// whitespace separated number lists parsed in place from the xml text buffer,
+// without stream objects or temporary strings
+
+inline bool isNumberSeparator(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline const char *skipNumberSeparators(const char *p, const char *end)
+{
+    while (p < end && isNumberSeparator(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+// number of whitespace separated tokens in [p, end)
+inline size_t countTokens(const char *p, const char *end)
+{
+    size_t count = 0;
+    while (true)
+    {
+        p = skipNumberSeparators(p, end);
+        if (p == end)
+        {
+            return count;
+        }
+        count++;
+        while (p < end && !isNumberSeparator(*p))
+        {
+            p++;
+        }
+    }
+}
+
+// parses the next number and advances p past it, returns false at the end of the text or on malformed input
+template <typename T>
+inline bool parseNextNumber(const char *&p, const char *end, T &value)
+{
+    p = skipNumberSeparators(p, end);
+    if (p < end && *p == '+')
+    {
+        p++;
+    }
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc() || result.ptr == p)
+    {
+        return false;
+    }
+    p = result.ptr;
+    return true;
+}
+
+inline void parseVertexData(const char *text, std::vector<Vector3> &vertexData)
+{
+    vertexData.clear();
+    if (!text)
+    {
+        return;
+    }
+
+    const char *p = text;
+    const char *end = text + strlen(text);
+    vertexData.reserve(countTokens(p, end) / 3);
+
+    Vector3 vertex;
+    while (parseNextNumber(p, end, vertex.x) && parseNextNumber(p, end, vertex.y) && parseNextNumber(p, end, vertex.z))
+    {
+        vertexData.push_back(vertex);
+    }
+}
+
+inline void parseFaces(const char *text, std::vector<Face> &faces)
+{
+    faces.clear();
+    if (!text)
+    {
+        return;
+    }
+
+    const char *p = text;
+    const char *end = text + strlen(text);
+    faces.reserve(countTokens(p, end) / 3);
+
+    Face face;
+    while (parseNextNumber(p, end, face.vertex1) && parseNextNumber(p, end, face.vertex2) && parseNextNumber(p, end, face.vertex3))
+    {
+        faces.push_back(face);
+    }
+}
+
+#endif // NUMBERPARSER_H
@@ -3,30 +3,33 @@
 
 #include "Vector3.h"
 
-class Ray {
+template <typename T>
+class RayT {
     public:
-        Ray() {}
+        RayT() {}
 
-        Ray(Vector3 origin, Vector3 direction) {
+        RayT(Vector3T<T> origin, Vector3T<T> direction) {
             this->origin = origin;
             this->direction = direction;
         }
 
-        const Vector3& getOrigin() const {
+        const Vector3T<T>& getOrigin() const {
             return origin;
         }
 
-        const Vector3& getDirection() const {
+        const Vector3T<T>& getDirection() const {
             return direction;
         }
 
-        Vector3 at(double t) {
+        Vector3T<T> at(T t) const {
             return origin + t * direction;
         }
 
     private:
-        Vector3 origin;
-        Vector3 direction;
+        Vector3T<T> origin;
+        Vector3T<T> direction;
 };
 
+typedef RayT<Real> Ray;
+
 #endif // RAY_H
\ No newline at end of file
@@ -0,0 +1,199 @@
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include <cmath>
+#include "Intersection.h"
+
+// primary rays of a PACKET_SIZE x PACKET_SIZE block of pixels, traced through the BVH together.
+// the rays are stored in groups of PACKET_LANES, group g holds rays g * PACKET_LANES and up,
+// every component of a group is one vector so the kernels test one triangle against a whole group
+const int PACKET_SIZE = 8;
+const int PACKET_RAYS = PACKET_SIZE * PACKET_SIZE;
+const int PACKET_LANES = 8;
+const int PACKET_GROUPS = PACKET_RAYS / PACKET_LANES;
+
+typedef float PacketFloats __attribute__((vector_size(PACKET_LANES * sizeof(float))));
+// comparisons of PacketFloats give -1 in the lanes where they hold and 0 elsewhere
+typedef int PacketInts __attribute__((vector_size(PACKET_LANES * sizeof(int))));
+
+inline bool anyRay(const PacketInts &mask)
+{
+    int any = 0;
+    for (int lane = 0; lane < PACKET_LANES; lane++)
+    {
+        any |= mask[lane];
+    }
+    return any != 0;
+}
+
+class alignas(32) RayPacket {
+public:
+    PacketFloats originX[PACKET_GROUPS];
+    PacketFloats originY[PACKET_GROUPS];
+    PacketFloats originZ[PACKET_GROUPS];
+    PacketFloats directionX[PACKET_GROUPS];
+    PacketFloats directionY[PACKET_GROUPS];
+    PacketFloats directionZ[PACKET_GROUPS];
+    PacketFloats inverseX[PACKET_GROUPS];
+    PacketFloats inverseY[PACKET_GROUPS];
+    PacketFloats inverseZ[PACKET_GROUPS];
+    // -1 for the rays that are traced, rays of pixels outside the image are never tested
+    PacketInts active[PACKET_GROUPS];
+
+    // distance to the closest hit so far, INFINITY while nothing is hit
+    PacketFloats t[PACKET_GROUPS];
+    // closest hit so far: the triangle index, -2 - the sphere index for spheres, -1 while nothing is hit
+    PacketInts primitive[PACKET_GROUPS];
+
+    // the rays in full precision, used for the spheres and the hit records
+    Ray rays[PACKET_RAYS];
+
+    // bounds of the whole packet, set by prepare(). only valid when every active ray
+    // points the same way along each axis, otherwise coherent is false
+    bool coherent;
+    Vector3 originMin;
+    Vector3 originMax;
+    Vector3 inverseMin;
+    Vector3 inverseMax;
+    // largest t of the active rays, nodes farther than every closest hit are culled
+    float tMax;
+
+    void setRay(int r, const Ray &ray, bool isActive)
+    {
+        int g = r / PACKET_LANES;
+        int lane = r % PACKET_LANES;
+        const Vector3 &origin = ray.getOrigin();
+        const Vector3 &direction = ray.getDirection();
+
+        rays[r] = ray;
+        originX[g][lane] = origin.x;
+        originY[g][lane] = origin.y;
+        originZ[g][lane] = origin.z;
+        directionX[g][lane] = direction.x;
+        directionY[g][lane] = direction.y;
+        directionZ[g][lane] = direction.z;
+        // computed in Real and then rounded, like the single ray traversal does
+        inverseX[g][lane] = 1 / direction.x;
+        inverseY[g][lane] = 1 / direction.y;
+        inverseZ[g][lane] = 1 / direction.z;
+        active[g][lane] = isActive ? -1 : 0;
+        t[g][lane] = INFINITY;
+        primitive[g][lane] = -1;
+    }
+
+    // computes the packet bounds once every ray is set
+    void prepare()
+    {
+        coherent = true;
+        originMin = Vector3(INFINITY, INFINITY, INFINITY);
+        originMax = Vector3(-INFINITY, -INFINITY, -INFINITY);
+        inverseMin = originMin;
+        inverseMax = originMax;
+        tMax = INFINITY;
+
+        bool anyActive = false;
+        for (int r = 0; r < PACKET_RAYS; r++)
+        {
+            int g = r / PACKET_LANES;
+            int lane = r % PACKET_LANES;
+            if (!active[g][lane])
+            {
+                continue;
+            }
+            anyActive = true;
+
+            Vector3 origin(originX[g][lane], originY[g][lane], originZ[g][lane]);
+            Vector3 inverse(inverseX[g][lane], inverseY[g][lane], inverseZ[g][lane]);
+            originMin = Vector3(std::fmin(originMin.x, origin.x), std::fmin(originMin.y, origin.y), std::fmin(originMin.z, origin.z));
+            originMax = Vector3(std::fmax(originMax.x, origin.x), std::fmax(originMax.y, origin.y), std::fmax(originMax.z, origin.z));
+            inverseMin = Vector3(std::fmin(inverseMin.x, inverse.x), std::fmin(inverseMin.y, inverse.y), std::fmin(inverseMin.z, inverse.z));
+            inverseMax = Vector3(std::fmax(inverseMax.x, inverse.x), std::fmax(inverseMax.y, inverse.y), std::fmax(inverseMax.z, inverse.z));
+        }
+
+        // a direction component of zero, or of both signs, leaves no finite interval to cull with
+        coherent = anyActive &&
+                   sameSign(inverseMin.x, inverseMax.x) && sameSign(inverseMin.y, inverseMax.y) && sameSign(inverseMin.z, inverseMax.z);
+    }
+
+    // recomputes tMax after hits were found
+    void updateTMax()
+    {
+        float largest = -INFINITY;
+        for (int g = 0; g < PACKET_GROUPS; g++)
+        {
+            for (int lane = 0; lane < PACKET_LANES; lane++)
+            {
+                if (active[g][lane])
+                {
+                    largest = std::fmax(largest, t[g][lane]);
+                }
+            }
+        }
+        tMax = largest;
+    }
+
+private:
+    static bool sameSign(Real low, Real high)
+    {
+        return std::isfinite(low) && std::isfinite(high) && (low > 0 || high < 0);
+    }
+};
+
+// one triangle against the rays of group g in mask, with the same operations and epsilons as the
+// single ray kernels, so a ray finds the same distance whichever way it is traced.
+// rays hit closer than their closest hit so far record the triangle, returns true when any of them does
+inline bool intersectTriangleGroup(RayPacket &packet, int g, const PacketInts &mask, const CompiledTriangle &triangle, int triangleIndex)
+{
+    const float epsilon = 0.00001f;
+
+    const PacketFloats &dx = packet.directionX[g];
+    const PacketFloats &dy = packet.directionY[g];
+    const PacketFloats &dz = packet.directionZ[g];
+
+    float e1x = triangle.edge1.x;
+    float e1y = triangle.edge1.y;
+    float e1z = triangle.edge1.z;
+    float e2x = triangle.edge2.x;
+    float e2y = triangle.edge2.y;
+    float e2z = triangle.edge2.z;
+
+    // h = d x e2, a = e1 . h
+    PacketFloats hx = dy * e2z - dz * e2y;
+    PacketFloats hy = dz * e2x - dx * e2z;
+    PacketFloats hz = dx * e2y - dy * e2x;
+    PacketFloats a = e1x * hx + e1y * hy + e1z * hz;
+
+    PacketInts hit = mask & ((a >= epsilon) | (a <= -epsilon));
+    if (!anyRay(hit))
+    {
+        return false;
+    }
+
+    PacketFloats f = 1.0f / a;
+
+    // s = o - vertex, u = f * (s . h)
+    PacketFloats sx = packet.originX[g] - (float)triangle.vertex.x;
+    PacketFloats sy = packet.originY[g] - (float)triangle.vertex.y;
+    PacketFloats sz = packet.originZ[g] - (float)triangle.vertex.z;
+    PacketFloats u = f * (sx * hx + sy * hy + sz * hz);
+    hit &= (u >= 0.0f) & (u <= 1.0f);
+
+    // q = s x e1, v = f * (d . q)
+    PacketFloats qx = sy * e1z - sz * e1y;
+    PacketFloats qy = sz * e1x - sx * e1z;
+    PacketFloats qz = sx * e1y - sy * e1x;
+    PacketFloats v = f * (dx * qx + dy * qy + dz * qz);
+    hit &= (v >= 0.0f) & (u + v <= 1.0f);
+
+    // t = f * (e2 . q)
+    PacketFloats t = f * (e2x * qx + e2y * qy + e2z * qz);
+    hit &= (t > epsilon) & (t < packet.t[g]);
+
+    PacketInts index = {};
+    index += triangleIndex;
+    packet.t[g] = hit ? t : packet.t[g];
+    packet.primitive[g] = hit ? index : packet.primitive[g];
+    return anyRay(hit);
+}
+
+#endif // RAYPACKET_H
@@ -0,0 +1,102 @@
+#include "RenderStats.h"
+#include <fstream>
+#include <iomanip>
+#include "TriangleSimd.h"
+
+namespace
+{
+    double perRay(uint64_t count, uint64_t rays)
+    {
+        return rays > 0 ? (double)count / rays : 0;
+    }
+
+    // json string literal, the scene name is the only free text in the report
+    std::string jsonString(const std::string &value)
+    {
+        std::string result = "\"";
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result + "\"";
+    }
+}
+
+double RenderStats::megaRaysPerSecond() const
+{
+    return times.render > 0 ? rays.totalRays() / times.render / 1e6 : 0;
+}
+
+void RenderStats::print(std::ostream &out) const
+{
+    out << std::fixed << std::setprecision(4);
+    out << "Phase times" << (loadedFromCache ? " (scene loaded from cache)" : "") << std::endl;
+    out << "  parse:              " << times.parse << "s" << std::endl;
+    out << "  acceleration build: " << times.accelerationBuild << "s" << std::endl;
+    out << "  scene update:       " << times.sceneUpdate << "s" << std::endl;
+    out << "  camera setup:       " << times.cameraSetup << "s" << std::endl;
+    out << "  render:             " << times.render << "s" << std::endl;
+    out << "  image write:        " << times.imageWrite << "s" << std::endl;
+    out << "  total:              " << times.total() << "s" << std::endl;
+
+    out << std::setprecision(2);
+    out << "Rays (" << cameraCount << " cameras, " << frameCount << " frames, " << pixelCount << " pixels, " << threadCount << " threads)" << std::endl;
+    out << "  primary:            " << rays.primaryRays << std::endl;
+    out << "  shadow:             " << rays.shadowRays << std::endl;
+    out << "  reflection:         " << rays.reflectionRays << std::endl;
+    out << "  triangle tests/ray: " << perRay(rays.triangleTests, rays.totalRays()) << std::endl;
+    out << "  sphere tests/ray:   " << perRay(rays.sphereTests, rays.totalRays()) << std::endl;
+    out << "  node visits/ray:    " << perRay(rays.nodeVisits, rays.totalRays()) << std::endl;
+    out << "  throughput:         " << megaRaysPerSecond() << " Mrays/s" << std::endl;
+    out << std::defaultfloat;
+}
+
+bool RenderStats::writeJson(const std::string &fileName) const
+{
+    std::ofstream out(fileName);
+    if (!out)
+    {
+        return false;
+    }
+
+    out << std::setprecision(9);
+    out << "{" << std::endl;
+    out << "  \"scene\": " << jsonString(sceneName) << "," << std::endl;
+#ifdef RT_DOUBLE
+    out << "  \"precision\": \"double\"," << std::endl;
+#else
+    out << "  \"precision\": \"float\"," << std::endl;
+#endif
+    out << "  \"simdWidth\": " << SIMD_WIDTH << "," << std::endl;
+    out << "  \"threads\": " << threadCount << "," << std::endl;
+    out << "  \"cameras\": " << cameraCount << "," << std::endl;
+    out << "  \"frames\": " << frameCount << "," << std::endl;
+    out << "  \"pixels\": " << pixelCount << "," << std::endl;
+    out << "  \"loadedFromCache\": " << (loadedFromCache ? "true" : "false") << "," << std::endl;
+    out << "  \"phases\": {" << std::endl;
+    out << "    \"parse\": " << times.parse << "," << std::endl;
+    out << "    \"accelerationBuild\": " << times.accelerationBuild << "," << std::endl;
+    out << "    \"sceneUpdate\": " << times.sceneUpdate << "," << std::endl;
+    out << "    \"cameraSetup\": " << times.cameraSetup << "," << std::endl;
+    out << "    \"render\": " << times.render << "," << std::endl;
+    out << "    \"imageWrite\": " << times.imageWrite << "," << std::endl;
+    out << "    \"total\": " << times.total() << std::endl;
+    out << "  }," << std::endl;
+    out << "  \"rays\": {" << std::endl;
+    out << "    \"primary\": " << rays.primaryRays << "," << std::endl;
+    out << "    \"shadow\": " << rays.shadowRays << "," << std::endl;
+    out << "    \"reflection\": " << rays.reflectionRays << "," << std::endl;
+    out << "    \"total\": " << rays.totalRays() << std::endl;
+    out << "  }," << std::endl;
+    out << "  \"triangleTestsPerRay\": " << perRay(rays.triangleTests, rays.totalRays()) << "," << std::endl;
+    out << "  \"sphereTestsPerRay\": " << perRay(rays.sphereTests, rays.totalRays()) << "," << std::endl;
+    out << "  \"nodeVisitsPerRay\": " << perRay(rays.nodeVisits, rays.totalRays()) << "," << std::endl;
+    out << "  \"mraysPerSecond\": " << megaRaysPerSecond() << std::endl;
+    out << "}" << std::endl;
+
+    return (bool)out;
+}
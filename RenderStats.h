@@ -0,0 +1,87 @@
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// rays traced and acceleration structure work done while rendering
+class RayCounters {
+public:
+    uint64_t primaryRays = 0;
+    uint64_t shadowRays = 0;
+    uint64_t reflectionRays = 0;
+    // triangle lanes evaluated by the intersection kernels, padding lanes included
+    uint64_t triangleTests = 0;
+    uint64_t sphereTests = 0;
+    uint64_t nodeVisits = 0;
+
+    uint64_t totalRays() const
+    {
+        return primaryRays + shadowRays + reflectionRays;
+    }
+
+    void add(const RayCounters &other)
+    {
+        primaryRays += other.primaryRays;
+        shadowRays += other.shadowRays;
+        reflectionRays += other.reflectionRays;
+        triangleTests += other.triangleTests;
+        sphereTests += other.sphereTests;
+        nodeVisits += other.nodeVisits;
+    }
+};
+
+// counters of the calling thread, every render worker counts into its own copy without synchronization
+inline thread_local RayCounters threadRayCounters;
+
+// wall clock seconds spent in each phase of a run
+class PhaseTimes {
+public:
+    double parse = 0;
+    double accelerationBuild = 0;
+    // moving the animated cameras and geometry to each frame
+    double sceneUpdate = 0;
+    double cameraSetup = 0;
+    double render = 0;
+    double imageWrite = 0;
+
+    double total() const
+    {
+        return parse + accelerationBuild + sceneUpdate + cameraSetup + render + imageWrite;
+    }
+};
+
+class RenderStats {
+public:
+    std::string sceneName;
+    bool loadedFromCache = false;
+    int threadCount = 0;
+    int cameraCount = 0;
+    // frames of an animation, every camera is rendered once per frame
+    int frameCount = 1;
+    uint64_t pixelCount = 0;
+    PhaseTimes times;
+    RayCounters rays;
+
+    // adds the counters of the calling thread to rays and resets them, called by every worker after a render
+    void collectThreadCounters()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rays.add(threadRayCounters);
+        threadRayCounters = RayCounters();
+    }
+
+    double megaRaysPerSecond() const;
+
+    void print(std::ostream &out) const;
+
+    // writes the report as a single json object, returns false when the file cannot be written
+    bool writeJson(const std::string &fileName) const;
+
+private:
+    std::mutex mutex;
+};
+
+#endif // RENDERSTATS_H
@@ -0,0 +1,428 @@
+#include "SceneCache.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const char MAGIC[8] = {'R', 'T', 'B', 'I', 'N', 0, 0, 0};
+    const uint32_t VERSION = 10;
+
+    // arrays start on cache line boundaries inside the file
+    const size_t ALIGNMENT = 64;
+
+    class CacheHeader {
+    public:
+        char magic[8];
+        uint32_t version;
+        uint32_t simdWidth;
+        uint64_t sourceHash;
+        // sizes of the stored records, a build with a different layout never reads the cache
+        uint32_t vector3Size;
+        uint32_t cameraSize;
+        uint32_t triangleSize;
+        uint32_t blockSize;
+        uint32_t nodeSize;
+        uint32_t hasBVH;
+    };
+
+    CacheHeader makeHeader(uint64_t sourceHash, bool hasBVH)
+    {
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.simdWidth = SIMD_WIDTH;
+        header.sourceHash = sourceHash;
+        header.vector3Size = sizeof(Vector3);
+        header.cameraSize = sizeof(Camera);
+        header.triangleSize = sizeof(CompiledTriangle);
+        header.blockSize = sizeof(TriangleBlock);
+        header.nodeSize = sizeof(BVHNode);
+        header.hasBVH = hasBVH;
+        return header;
+    }
+
+    class CacheWriter {
+    public:
+        FILE *file;
+        size_t offset = 0;
+        bool ok = true;
+
+        template <typename T>
+        void write(const T &value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain records can be cached");
+            writeBytes(&value, sizeof(T));
+        }
+
+        template <typename T>
+        void writeArray(const std::vector<T> &values)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain records can be cached");
+            write((uint64_t)values.size());
+            pad();
+            writeBytes(values.data(), values.size() * sizeof(T));
+        }
+
+        void writeString(const std::string &value)
+        {
+            write((uint64_t)value.size());
+            writeBytes(value.data(), value.size());
+        }
+
+    private:
+        void writeBytes(const void *data, size_t size)
+        {
+            if (size > 0 && fwrite(data, 1, size, file) != size)
+            {
+                ok = false;
+            }
+            offset += size;
+        }
+
+        void pad()
+        {
+            static const char zeros[ALIGNMENT] = {};
+            writeBytes(zeros, (ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT);
+        }
+    };
+
+    class CacheReader {
+    public:
+        const char *data;
+        size_t size;
+        size_t offset = 0;
+        bool ok = true;
+
+        template <typename T>
+        void read(T &value)
+        {
+            readBytes(&value, sizeof(T));
+        }
+
+        template <typename T>
+        void readArray(std::vector<T> &values)
+        {
+            uint64_t count = 0;
+            read(count);
+            offset += (ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT;
+            if (!ok || count > (size - std::min(offset, size)) / sizeof(T))
+            {
+                ok = false;
+                return;
+            }
+            values.resize(count);
+            readBytes(values.data(), count * sizeof(T));
+        }
+
+        void readString(std::string &value)
+        {
+            uint64_t length = 0;
+            read(length);
+            if (!ok || length > size - std::min(offset, size))
+            {
+                ok = false;
+                return;
+            }
+            value.assign(data + offset, length);
+            offset += length;
+        }
+
+    private:
+        void readBytes(void *destination, size_t length)
+        {
+            if (!ok || offset > size || length > size - offset)
+            {
+                ok = false;
+                return;
+            }
+            memcpy(destination, data + offset, length);
+            offset += length;
+        }
+    };
+}
+
+uint64_t hashSceneFile(const std::string &fileName)
+{
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    unsigned char buffer[1 << 16];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    fclose(file);
+    return hash;
+}
+
+bool saveSceneCache(const std::string &cacheName, uint64_t sourceHash, bool withBVH, const Scene &scene, const CompiledScene &compiled)
+{
+    // write to a temporary file first so a concurrent reader never sees a half written cache
+    std::string temporaryName = cacheName + ".tmp";
+    FILE *file = fopen(temporaryName.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    CacheWriter writer;
+    writer.file = file;
+    writer.write(makeHeader(sourceHash, withBVH));
+
+    writer.write(scene.maxRayTraceDepth);
+    writer.write(scene.backgroundColor);
+    writer.write(scene.shadowRayEpsilon);
+    writer.write((uint64_t)scene.cameras.size());
+    for (const Camera &camera : scene.cameras)
+    {
+        writer.write(camera.id);
+        writer.write(camera.position);
+        writer.write(camera.gaze);
+        writer.write(camera.up);
+        writer.write(camera.nearPlane);
+        writer.write(camera.nearDistance);
+        writer.write(camera.imageResolution);
+        writer.write(camera.numSamples);
+        writer.writeString(camera.imageName);
+    }
+    writer.write(scene.ambientLight);
+    writer.writeArray(scene.pointLights);
+    writer.writeArray(scene.triangularLights);
+    writer.writeArray(scene.materials);
+    writer.writeArray(scene.vertexData);
+
+    writer.write((uint64_t)scene.meshes.size());
+    for (const Mesh &mesh : scene.meshes)
+    {
+        writer.write(mesh.id);
+        writer.write(mesh.materialId);
+        writer.writeArray(mesh.faces);
+        writer.write(mesh.isTriangle);
+    }
+    writer.writeArray(scene.meshInstances);
+    writer.writeArray(scene.spheres);
+
+    const Animation &animation = scene.animation;
+    writer.write(animation.frameCount);
+    writer.write((uint64_t)animation.cameraTracks.size());
+    for (const CameraTrack &track : animation.cameraTracks)
+    {
+        writer.write(track.cameraId);
+        writer.writeArray(track.keys);
+    }
+    for (const std::vector<ObjectTrack> *tracks : {&animation.meshTracks, &animation.instanceTracks})
+    {
+        writer.write((uint64_t)tracks->size());
+        for (const ObjectTrack &track : *tracks)
+        {
+            writer.write(track.objectId);
+            writer.writeArray(track.keys);
+        }
+    }
+
+    writer.writeArray(compiled.triangles);
+    writer.writeArray(compiled.blocks);
+    writer.writeArray(compiled.spheres.centerX);
+    writer.writeArray(compiled.spheres.centerY);
+    writer.writeArray(compiled.spheres.centerZ);
+    writer.writeArray(compiled.spheres.radius);
+    writer.writeArray(compiled.spheres.materialId);
+    writer.writeArray(compiled.spheres.objectId);
+    if (withBVH)
+    {
+        writer.writeArray(compiled.bvh.nodes);
+        writer.writeArray(compiled.bvh.blocks);
+        writer.write(compiled.bvh.stats);
+    }
+
+    // the instances are built with or without the BVH setting, each instanced mesh keeps its own BVH
+    writer.write((uint64_t)compiled.instances.meshes.size());
+    for (const InstancedMesh &mesh : compiled.instances.meshes)
+    {
+        writer.write(mesh.meshId);
+        writer.writeArray(mesh.triangles);
+        writer.writeArray(mesh.bvh.nodes);
+        writer.writeArray(mesh.bvh.blocks);
+        writer.write(mesh.bvh.stats);
+    }
+    writer.writeArray(compiled.instances.instances);
+    writer.writeArray(compiled.instances.nodes);
+
+    bool ok = writer.ok;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporaryName.c_str(), cacheName.c_str()) != 0)
+    {
+        remove(temporaryName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadSceneCache(const std::string &cacheName, uint64_t sourceHash, bool withBVH, Scene *scene, CompiledScene *compiled)
+{
+    int fd = open(cacheName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(CacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = fileStat.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    CacheReader reader;
+    reader.data = (const char *)mapping;
+    reader.size = size;
+
+    CacheHeader header;
+    reader.read(header);
+    CacheHeader expected = makeHeader(sourceHash, withBVH);
+    if (memcmp(&header, &expected, sizeof(CacheHeader)) != 0)
+    {
+        munmap(mapping, size);
+        return false;
+    }
+
+    reader.read(scene->maxRayTraceDepth);
+    reader.read(scene->backgroundColor);
+    reader.read(scene->shadowRayEpsilon);
+    uint64_t cameraCount = 0;
+    reader.read(cameraCount);
+    scene->cameras.clear();
+    for (uint64_t i = 0; i < cameraCount && reader.ok; i++)
+    {
+        Camera camera;
+        reader.read(camera.id);
+        reader.read(camera.position);
+        reader.read(camera.gaze);
+        reader.read(camera.up);
+        reader.read(camera.nearPlane);
+        reader.read(camera.nearDistance);
+        reader.read(camera.imageResolution);
+        reader.read(camera.numSamples);
+        reader.readString(camera.imageName);
+        scene->cameras.push_back(std::move(camera));
+    }
+    reader.read(scene->ambientLight);
+    reader.readArray(scene->pointLights);
+    reader.readArray(scene->triangularLights);
+    reader.readArray(scene->materials);
+    reader.readArray(scene->vertexData);
+
+    uint64_t meshCount = 0;
+    reader.read(meshCount);
+    scene->meshes.clear();
+    for (uint64_t i = 0; i < meshCount && reader.ok; i++)
+    {
+        Mesh mesh;
+        reader.read(mesh.id);
+        reader.read(mesh.materialId);
+        reader.readArray(mesh.faces);
+        reader.read(mesh.isTriangle);
+        scene->meshes.push_back(std::move(mesh));
+    }
+    reader.readArray(scene->meshInstances);
+    reader.readArray(scene->spheres);
+
+    Animation &animation = scene->animation;
+    animation = Animation();
+    reader.read(animation.frameCount);
+    uint64_t trackCount = 0;
+    reader.read(trackCount);
+    for (uint64_t i = 0; i < trackCount && reader.ok; i++)
+    {
+        CameraTrack track;
+        reader.read(track.cameraId);
+        reader.readArray(track.keys);
+        animation.cameraTracks.push_back(std::move(track));
+    }
+    for (std::vector<ObjectTrack> *tracks : {&animation.meshTracks, &animation.instanceTracks})
+    {
+        trackCount = 0;
+        reader.read(trackCount);
+        for (uint64_t i = 0; i < trackCount && reader.ok; i++)
+        {
+            ObjectTrack track;
+            reader.read(track.objectId);
+            reader.readArray(track.keys);
+            tracks->push_back(std::move(track));
+        }
+    }
+
+    reader.readArray(compiled->triangles);
+    reader.readArray(compiled->blocks);
+    reader.readArray(compiled->spheres.centerX);
+    reader.readArray(compiled->spheres.centerY);
+    reader.readArray(compiled->spheres.centerZ);
+    reader.readArray(compiled->spheres.radius);
+    reader.readArray(compiled->spheres.materialId);
+    reader.readArray(compiled->spheres.objectId);
+    size_t sphereCount = compiled->spheres.radius.size();
+    if (compiled->spheres.centerX.size() != sphereCount || compiled->spheres.centerY.size() != sphereCount ||
+        compiled->spheres.centerZ.size() != sphereCount || compiled->spheres.materialId.size() != sphereCount ||
+        compiled->spheres.objectId.size() != sphereCount)
+    {
+        reader.ok = false;
+    }
+    if (withBVH)
+    {
+        reader.readArray(compiled->bvh.nodes);
+        reader.readArray(compiled->bvh.blocks);
+        reader.read(compiled->bvh.stats);
+    }
+
+    uint64_t instancedMeshCount = 0;
+    reader.read(instancedMeshCount);
+    compiled->instances.meshes.clear();
+    for (uint64_t i = 0; i < instancedMeshCount && reader.ok; i++)
+    {
+        InstancedMesh mesh;
+        reader.read(mesh.meshId);
+        reader.readArray(mesh.triangles);
+        reader.readArray(mesh.bvh.nodes);
+        reader.readArray(mesh.bvh.blocks);
+        reader.read(mesh.bvh.stats);
+        compiled->instances.meshes.push_back(std::move(mesh));
+    }
+    reader.readArray(compiled->instances.instances);
+    reader.readArray(compiled->instances.nodes);
+    for (const CompiledInstance &instance : compiled->instances.instances)
+    {
+        if (instance.mesh < 0 || instance.mesh >= (int)compiled->instances.meshes.size() ||
+            instance.sceneMesh >= (int)scene->meshes.size())
+        {
+            reader.ok = false;
+        }
+    }
+
+    munmap(mapping, size);
+    return reader.ok;
+}
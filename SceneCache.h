@@ -0,0 +1,25 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <cstdint>
+#include <string>
+#include "SceneXmlModel.h"
+#include "CompiledScene.h"
+
+// binary snapshot of a loaded and compiled scene (.rtbin). it holds the cameras, lights,
+// materials, vertex and face buffers, the compiled triangles and, when one was built, the BVH,
+// the mesh instances with the bottom level BVHs of the meshes they place, and the keys of the animation.
+// a cache is only used when it was written from a source file with the same hash
+// by a build with the same layout and SIMD width.
+
+// FNV-1a hash of the file contents, 0 when the file cannot be read
+uint64_t hashSceneFile(const std::string &fileName);
+
+// maps the cache file and fills scene and compiled from it, returns false when the cache is
+// missing, stale, built with a different BVH setting or unreadable
+bool loadSceneCache(const std::string &cacheName, uint64_t sourceHash, bool withBVH, Scene *scene, CompiledScene *compiled);
+
+// withBVH is the setting compiled was built with, its BVH is empty when the scene only has instances
+bool saveSceneCache(const std::string &cacheName, uint64_t sourceHash, bool withBVH, const Scene &scene, const CompiledScene &compiled);
+
+#endif // SCENECACHE_H
@@ -0,0 +1,854 @@
+#include "SceneLoader.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <strings.h>
+#include "NumberParser.h"
+#include "tinyxml2.h"
+
+using namespace tinyxml2;
+
+namespace
+{
+    // every element the loader understands, the names of both schemas map onto these
+    enum class Tag {
+        Unknown,
+        Scene,
+        MaxRayTraceDepth,
+        BackgroundColor,
+        ShadowRayEpsilon,
+        Cameras,
+        Camera,
+        Position,
+        Gaze,
+        Up,
+        NearPlane,
+        NearDistance,
+        ImageResolution,
+        ImageName,
+        NumSamples,
+        Lights,
+        AmbientLight,
+        PointLight,
+        TriangularLight,
+        Intensity,
+        Vertex1,
+        Vertex2,
+        Vertex3,
+        Materials,
+        Material,
+        Ambient,
+        Diffuse,
+        Specular,
+        MirrorReflectance,
+        PhongExponent,
+        VertexData,
+        Objects,
+        Mesh,
+        Triangle,
+        Sphere,
+        MaterialId,
+        Faces,
+        Indices,
+        Center,
+        Radius,
+        Transformations,
+        Translation,
+        Scaling,
+        Rotation,
+        MeshInstance,
+        Animation,
+        Key
+    };
+
+    // FNV-1a of the lowercased name
+    constexpr uint32_t tagHash(const char *name)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *name; name++)
+        {
+            char c = *name >= 'A' && *name <= 'Z' ? *name - 'A' + 'a' : *name;
+            hash = (hash ^ (unsigned char)c) * 16777619u;
+        }
+        return hash;
+    }
+
+    // one switch on the hash finds the candidate tag, the compiler rejects two names with the same hash.
+    // an unknown name that happens to share the hash of a known one fails the final comparison
+    Tag tagOf(const char *name)
+    {
+        const char *spelling;
+        Tag tag;
+        switch (tagHash(name))
+        {
+#define SCENE_TAG(text, value)  \
+    case tagHash(text):         \
+        spelling = text;        \
+        tag = value;            \
+        break;
+            SCENE_TAG("scene", Tag::Scene)
+            SCENE_TAG("maxraytracedepth", Tag::MaxRayTraceDepth)
+            SCENE_TAG("maxrecursiondepth", Tag::MaxRayTraceDepth)
+            SCENE_TAG("backgroundcolor", Tag::BackgroundColor)
+            SCENE_TAG("shadowrayepsilon", Tag::ShadowRayEpsilon)
+            SCENE_TAG("cameras", Tag::Cameras)
+            SCENE_TAG("camera", Tag::Camera)
+            SCENE_TAG("position", Tag::Position)
+            SCENE_TAG("gaze", Tag::Gaze)
+            SCENE_TAG("up", Tag::Up)
+            SCENE_TAG("nearplane", Tag::NearPlane)
+            SCENE_TAG("neardistance", Tag::NearDistance)
+            SCENE_TAG("imageresolution", Tag::ImageResolution)
+            SCENE_TAG("imagename", Tag::ImageName)
+            SCENE_TAG("numsamples", Tag::NumSamples)
+            SCENE_TAG("lights", Tag::Lights)
+            SCENE_TAG("ambientlight", Tag::AmbientLight)
+            SCENE_TAG("pointlight", Tag::PointLight)
+            SCENE_TAG("triangularlight", Tag::TriangularLight)
+            SCENE_TAG("intensity", Tag::Intensity)
+            SCENE_TAG("vertex1", Tag::Vertex1)
+            SCENE_TAG("vertex2", Tag::Vertex2)
+            SCENE_TAG("vertex3", Tag::Vertex3)
+            SCENE_TAG("materials", Tag::Materials)
+            SCENE_TAG("material", Tag::Material)
+            SCENE_TAG("ambient", Tag::Ambient)
+            SCENE_TAG("ambientreflectance", Tag::Ambient)
+            SCENE_TAG("diffuse", Tag::Diffuse)
+            SCENE_TAG("diffusereflectance", Tag::Diffuse)
+            SCENE_TAG("specular", Tag::Specular)
+            SCENE_TAG("specularreflectance", Tag::Specular)
+            SCENE_TAG("mirrorreflectance", Tag::MirrorReflectance)
+            SCENE_TAG("phongexponent", Tag::PhongExponent)
+            SCENE_TAG("vertexdata", Tag::VertexData)
+            SCENE_TAG("objects", Tag::Objects)
+            SCENE_TAG("mesh", Tag::Mesh)
+            SCENE_TAG("triangle", Tag::Triangle)
+            SCENE_TAG("sphere", Tag::Sphere)
+            SCENE_TAG("materialid", Tag::MaterialId)
+            SCENE_TAG("faces", Tag::Faces)
+            SCENE_TAG("indices", Tag::Indices)
+            SCENE_TAG("center", Tag::Center)
+            SCENE_TAG("radius", Tag::Radius)
+            SCENE_TAG("transformations", Tag::Transformations)
+            SCENE_TAG("translation", Tag::Translation)
+            SCENE_TAG("scaling", Tag::Scaling)
+            SCENE_TAG("rotation", Tag::Rotation)
+            SCENE_TAG("meshinstance", Tag::MeshInstance)
+            SCENE_TAG("animation", Tag::Animation)
+            SCENE_TAG("key", Tag::Key)
+#undef SCENE_TAG
+        default:
+            return Tag::Unknown;
+        }
+        return strcasecmp(name, spelling) == 0 ? tag : Tag::Unknown;
+    }
+
+    // the number parsers below leave the value unchanged when the text is missing or malformed,
+    // the ones returning bool return false then
+
+    template <typename T>
+    void readNumber(const XMLElement *element, T &value)
+    {
+        const char *text = element->GetText();
+        if (text)
+        {
+            T parsed;
+            if (parseNextNumber(text, text + strlen(text), parsed))
+            {
+                value = parsed;
+            }
+        }
+    }
+
+    bool readVector(const XMLElement *element, Vector3 &vector)
+    {
+        const char *text = element->GetText();
+        if (text)
+        {
+            const char *end = text + strlen(text);
+            Vector3 parsed;
+            if (parseNextNumber(text, end, parsed.x) && parseNextNumber(text, end, parsed.y) && parseNextNumber(text, end, parsed.z))
+            {
+                vector = parsed;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void readNearPlane(const XMLElement *element, NearPlane &nearPlane)
+    {
+        const char *text = element->GetText();
+        if (text)
+        {
+            const char *end = text + strlen(text);
+            NearPlane parsed;
+            if (parseNextNumber(text, end, parsed.left) && parseNextNumber(text, end, parsed.right) &&
+                parseNextNumber(text, end, parsed.bottom) && parseNextNumber(text, end, parsed.top))
+            {
+                nearPlane = parsed;
+            }
+        }
+    }
+
+    void readImageResolution(const XMLElement *element, ImageResolution &imageResolution)
+    {
+        const char *text = element->GetText();
+        if (text)
+        {
+            const char *end = text + strlen(text);
+            ImageResolution parsed;
+            if (parseNextNumber(text, end, parsed.nx) && parseNextNumber(text, end, parsed.ny))
+            {
+                imageResolution = parsed;
+            }
+        }
+    }
+
+    // the angle in degrees, then the axis
+    bool readRotation(const XMLElement *element, Real &angle, Vector3 &axis)
+    {
+        const char *text = element->GetText();
+        if (text)
+        {
+            const char *end = text + strlen(text);
+            Real parsedAngle;
+            Vector3 parsedAxis;
+            if (parseNextNumber(text, end, parsedAngle) && parseNextNumber(text, end, parsedAxis.x) &&
+                parseNextNumber(text, end, parsedAxis.y) && parseNextNumber(text, end, parsedAxis.z))
+            {
+                angle = parsedAngle;
+                axis = parsedAxis;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // transformations of the transformations block by id, instances refer to them as t<id>, s<id> and r<id>
+    class TransformationLibrary {
+    public:
+        std::map<int, Transform> translations;
+        std::map<int, Transform> scalings;
+        std::map<int, Transform> rotations;
+    };
+
+    void parseTransformations(const XMLElement *transformationsElement, TransformationLibrary &library)
+    {
+        for (const XMLElement *element = transformationsElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            int id = 0;
+            element->QueryIntAttribute("id", &id);
+
+            Vector3 v;
+            Real angle;
+            switch (tagOf(element->Name()))
+            {
+            case Tag::Translation:
+                if (readVector(element, v))
+                {
+                    library.translations[id] = Transform::translation(v);
+                }
+                break;
+            case Tag::Scaling:
+                if (readVector(element, v))
+                {
+                    library.scalings[id] = Transform::scaling(v);
+                }
+                break;
+            case Tag::Rotation:
+                if (readRotation(element, angle, v))
+                {
+                    library.rotations[id] = Transform::rotation(angle, v);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // composes a list like "t1 r2 s1", the transformations are applied in the order they are listed
+    bool resolveTransformations(const std::string &references, const TransformationLibrary &library, Transform &transform)
+    {
+        transform = Transform();
+        const char *text = references.c_str();
+        const char *end = text + references.size();
+        while (true)
+        {
+            while (text < end && isspace((unsigned char)*text))
+            {
+                text++;
+            }
+            if (text == end)
+            {
+                return true;
+            }
+
+            char kind = tolower((unsigned char)*text++);
+            const std::map<int, Transform> *transformations = kind == 't' ? &library.translations
+                                                            : kind == 's' ? &library.scalings
+                                                            : kind == 'r' ? &library.rotations
+                                                                          : nullptr;
+            int id;
+            if (!transformations || !parseNextNumber(text, end, id) || !transformations->count(id))
+            {
+                return false;
+            }
+            transform = transformations->at(id) * transform;
+        }
+    }
+
+    void parseCamera(const XMLElement *cameraElement, Camera &camera)
+    {
+        cameraElement->QueryIntAttribute("id", &camera.id);
+        for (const XMLElement *element = cameraElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            switch (tagOf(element->Name()))
+            {
+            case Tag::Position:
+                readVector(element, camera.position);
+                break;
+            case Tag::Gaze:
+                readVector(element, camera.gaze);
+                break;
+            case Tag::Up:
+                readVector(element, camera.up);
+                break;
+            case Tag::NearPlane:
+                readNearPlane(element, camera.nearPlane);
+                break;
+            case Tag::NearDistance:
+                readNumber(element, camera.nearDistance);
+                break;
+            case Tag::ImageResolution:
+                readImageResolution(element, camera.imageResolution);
+                break;
+            case Tag::NumSamples:
+                readNumber(element, camera.numSamples);
+                break;
+            case Tag::ImageName:
+                if (element->GetText())
+                {
+                    camera.imageName = element->GetText();
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void parseLights(const XMLElement *lightsElement, Scene *scene)
+    {
+        for (const XMLElement *lightElement = lightsElement->FirstChildElement(); lightElement; lightElement = lightElement->NextSiblingElement())
+        {
+            switch (tagOf(lightElement->Name()))
+            {
+            case Tag::AmbientLight:
+                readVector(lightElement, scene->ambientLight);
+                break;
+            case Tag::PointLight:
+            {
+                PointLight pointLight = PointLight();
+                lightElement->QueryIntAttribute("id", &pointLight.id);
+                for (const XMLElement *element = lightElement->FirstChildElement(); element; element = element->NextSiblingElement())
+                {
+                    switch (tagOf(element->Name()))
+                    {
+                    case Tag::Position:
+                        readVector(element, pointLight.position);
+                        break;
+                    case Tag::Intensity:
+                        readVector(element, pointLight.intensity);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                scene->pointLights.push_back(pointLight);
+                break;
+            }
+            case Tag::TriangularLight:
+            {
+                TriangularLight triangularLight = TriangularLight();
+                lightElement->QueryIntAttribute("id", &triangularLight.id);
+                for (const XMLElement *element = lightElement->FirstChildElement(); element; element = element->NextSiblingElement())
+                {
+                    switch (tagOf(element->Name()))
+                    {
+                    case Tag::Vertex1:
+                        readVector(element, triangularLight.vertex1);
+                        break;
+                    case Tag::Vertex2:
+                        readVector(element, triangularLight.vertex2);
+                        break;
+                    case Tag::Vertex3:
+                        readVector(element, triangularLight.vertex3);
+                        break;
+                    case Tag::Intensity:
+                        readVector(element, triangularLight.intensity);
+                        break;
+                    case Tag::NumSamples:
+                        readNumber(element, triangularLight.numSamples);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                scene->triangularLights.push_back(triangularLight);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    void parseMaterials(const XMLElement *materialsElement, Scene *scene)
+    {
+        for (const XMLElement *materialElement = materialsElement->FirstChildElement(); materialElement; materialElement = materialElement->NextSiblingElement())
+        {
+            if (tagOf(materialElement->Name()) != Tag::Material)
+            {
+                continue;
+            }
+
+            Material material = Material();
+            materialElement->QueryIntAttribute("id", &material.id);
+            for (const XMLElement *element = materialElement->FirstChildElement(); element; element = element->NextSiblingElement())
+            {
+                switch (tagOf(element->Name()))
+                {
+                case Tag::Ambient:
+                    readVector(element, material.ambient);
+                    break;
+                case Tag::Diffuse:
+                    readVector(element, material.diffuse);
+                    break;
+                case Tag::Specular:
+                    readVector(element, material.specular);
+                    break;
+                case Tag::MirrorReflectance:
+                    readVector(element, material.mirrorReflectance);
+                    break;
+                case Tag::PhongExponent:
+                    readNumber(element, material.phongExponent);
+                    break;
+                default:
+                    break;
+                }
+            }
+            scene->materials.push_back(material);
+        }
+    }
+
+    // meshes list their faces, triangles are single face meshes listing their indices
+    void parseMesh(const XMLElement *meshElement, Mesh &mesh)
+    {
+        meshElement->QueryIntAttribute("id", &mesh.id);
+        for (const XMLElement *element = meshElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            switch (tagOf(element->Name()))
+            {
+            // the capitalized schema names the material of an object Material
+            case Tag::MaterialId:
+            case Tag::Material:
+                readNumber(element, mesh.materialId);
+                break;
+            case Tag::Faces:
+            case Tag::Indices:
+                parseFaces(element->GetText(), mesh.faces);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void parseSphere(const XMLElement *sphereElement, Sphere &sphere)
+    {
+        sphereElement->QueryIntAttribute("id", &sphere.id);
+        for (const XMLElement *element = sphereElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            switch (tagOf(element->Name()))
+            {
+            case Tag::MaterialId:
+            case Tag::Material:
+                readNumber(element, sphere.materialId);
+                break;
+            case Tag::Center:
+                readNumber(element, sphere.center);
+                break;
+            case Tag::Radius:
+                readNumber(element, sphere.radius);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // the transformation list of the instance is returned in transformations, it is resolved once the whole file is read
+    void parseMeshInstance(const XMLElement *instanceElement, MeshInstance &instance, std::string &transformations)
+    {
+        instanceElement->QueryIntAttribute("id", &instance.id);
+        instanceElement->QueryIntAttribute("baseMeshId", &instance.baseMeshId);
+        for (const XMLElement *element = instanceElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            switch (tagOf(element->Name()))
+            {
+            case Tag::MaterialId:
+            case Tag::Material:
+                readNumber(element, instance.materialId);
+                break;
+            case Tag::Transformations:
+                transformations = element->GetText() ? element->GetText() : "";
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void parseObjects(const XMLElement *objectsElement, Scene *scene, std::vector<std::string> &instanceTransformations)
+    {
+        for (const XMLElement *objectElement = objectsElement->FirstChildElement(); objectElement; objectElement = objectElement->NextSiblingElement())
+        {
+            switch (tagOf(objectElement->Name()))
+            {
+            case Tag::Mesh:
+            case Tag::Triangle:
+            {
+                Mesh mesh = Mesh();
+                parseMesh(objectElement, mesh);
+                mesh.isTriangle = tagOf(objectElement->Name()) == Tag::Triangle;
+                scene->meshes.push_back(std::move(mesh));
+                break;
+            }
+            case Tag::Sphere:
+            {
+                Sphere sphere = Sphere();
+                parseSphere(objectElement, sphere);
+                scene->spheres.push_back(sphere);
+                break;
+            }
+            case Tag::MeshInstance:
+            {
+                MeshInstance instance = MeshInstance();
+                std::string transformations;
+                parseMeshInstance(objectElement, instance, transformations);
+                scene->meshInstances.push_back(instance);
+                instanceTransformations.push_back(transformations);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    void parseCameraKey(const XMLElement *keyElement, CameraKey &key)
+    {
+        keyElement->QueryIntAttribute("frame", &key.frame);
+        for (const XMLElement *element = keyElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            switch (tagOf(element->Name()))
+            {
+            case Tag::Position:
+                readVector(element, key.position);
+                break;
+            case Tag::Gaze:
+                readVector(element, key.gaze);
+                break;
+            case Tag::Up:
+                readVector(element, key.up);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void parseObjectKey(const XMLElement *keyElement, ObjectKey &key)
+    {
+        keyElement->QueryIntAttribute("frame", &key.frame);
+        for (const XMLElement *element = keyElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            switch (tagOf(element->Name()))
+            {
+            case Tag::Scaling:
+                readVector(element, key.scaling);
+                break;
+            case Tag::Rotation:
+                readRotation(element, key.angle, key.axis);
+                break;
+            case Tag::Translation:
+                readVector(element, key.translation);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // the keys are sorted by frame, so the keys around a frame are found by one scan
+    template <typename Key, typename ParseKey>
+    void parseKeys(const XMLElement *trackElement, std::vector<Key> &keys, ParseKey parseKey)
+    {
+        for (const XMLElement *element = trackElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            if (tagOf(element->Name()) == Tag::Key)
+            {
+                keys.emplace_back();
+                parseKey(element, keys.back());
+            }
+        }
+        std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b)
+                         { return a.frame < b.frame; });
+    }
+
+    ObjectTrack parseObjectTrack(const XMLElement *trackElement)
+    {
+        ObjectTrack track = ObjectTrack();
+        trackElement->QueryIntAttribute("id", &track.objectId);
+        parseKeys(trackElement, track.keys, parseObjectKey);
+        return track;
+    }
+
+    // the animation block gives the number of frames and holds one Camera, Mesh or MeshInstance element
+    // per animated object, with the id of the object and its keys
+    void parseAnimation(const XMLElement *animationElement, Animation &animation)
+    {
+        animationElement->QueryIntAttribute("frames", &animation.frameCount);
+        for (const XMLElement *element = animationElement->FirstChildElement(); element; element = element->NextSiblingElement())
+        {
+            switch (tagOf(element->Name()))
+            {
+            case Tag::Camera:
+            {
+                CameraTrack track = CameraTrack();
+                element->QueryIntAttribute("id", &track.cameraId);
+                parseKeys(element, track.keys, parseCameraKey);
+                animation.cameraTracks.push_back(std::move(track));
+                break;
+            }
+            case Tag::Mesh:
+                animation.meshTracks.push_back(parseObjectTrack(element));
+                break;
+            case Tag::MeshInstance:
+                animation.instanceTracks.push_back(parseObjectTrack(element));
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // every track has to move an object of the scene, and interpolating between keys needs a camera
+    // basis and rotation axes that can be normalized
+    bool validateAnimation(const Scene &scene)
+    {
+        const Animation &animation = scene.animation;
+        if (animation.frameCount < 0)
+        {
+            std::cerr << "Animation has a negative frame count" << std::endl;
+            return false;
+        }
+        for (const CameraTrack &track : animation.cameraTracks)
+        {
+            if (std::none_of(scene.cameras.begin(), scene.cameras.end(), [&](const Camera &camera)
+                             { return camera.id == track.cameraId; }))
+            {
+                std::cerr << "Animation refers to no camera " << track.cameraId << std::endl;
+                return false;
+            }
+            for (const CameraKey &key : track.keys)
+            {
+                if (dot(key.gaze, key.gaze) == 0 || dot(key.up, key.up) == 0)
+                {
+                    std::cerr << "Key " << key.frame << " of camera " << track.cameraId << " needs a gaze and an up vector" << std::endl;
+                    return false;
+                }
+            }
+        }
+        for (const ObjectTrack &track : animation.meshTracks)
+        {
+            if (std::none_of(scene.meshes.begin(), scene.meshes.end(), [&](const Mesh &mesh)
+                             { return !mesh.isTriangle && mesh.id == track.objectId; }))
+            {
+                std::cerr << "Animation refers to no mesh " << track.objectId << std::endl;
+                return false;
+            }
+        }
+        for (const ObjectTrack &track : animation.instanceTracks)
+        {
+            if (std::none_of(scene.meshInstances.begin(), scene.meshInstances.end(), [&](const MeshInstance &instance)
+                             { return instance.id == track.objectId; }))
+            {
+                std::cerr << "Animation refers to no mesh instance " << track.objectId << std::endl;
+                return false;
+            }
+        }
+        for (const std::vector<ObjectTrack> *tracks : {&animation.meshTracks, &animation.instanceTracks})
+        {
+            for (const ObjectTrack &track : *tracks)
+            {
+                for (const ObjectKey &key : track.keys)
+                {
+                    if (dot(key.axis, key.axis) == 0)
+                    {
+                        std::cerr << "Key " << key.frame << " of object " << track.objectId << " has no rotation axis" << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // vertex and material indices are 1-based, objects referring outside the scene data would read past it
+    bool validateScene(const Scene &scene)
+    {
+        int vertexCount = scene.vertexData.size();
+        int materialCount = scene.materials.size();
+        for (const Mesh &mesh : scene.meshes)
+        {
+            if (mesh.materialId < 1 || mesh.materialId > materialCount)
+            {
+                std::cerr << "Mesh " << mesh.id << " has no material " << mesh.materialId << std::endl;
+                return false;
+            }
+            for (const Face &face : mesh.faces)
+            {
+                if (std::min({face.vertex1, face.vertex2, face.vertex3}) < 1 || std::max({face.vertex1, face.vertex2, face.vertex3}) > vertexCount)
+                {
+                    std::cerr << "Mesh " << mesh.id << " has a face outside the vertex data" << std::endl;
+                    return false;
+                }
+            }
+        }
+        for (const MeshInstance &instance : scene.meshInstances)
+        {
+            if (std::none_of(scene.meshes.begin(), scene.meshes.end(), [&](const Mesh &mesh)
+                             { return mesh.id == instance.baseMeshId; }))
+            {
+                std::cerr << "Mesh instance " << instance.id << " has no base mesh " << instance.baseMeshId << std::endl;
+                return false;
+            }
+            if (instance.materialId < 0 || instance.materialId > materialCount)
+            {
+                std::cerr << "Mesh instance " << instance.id << " has no material " << instance.materialId << std::endl;
+                return false;
+            }
+        }
+        for (const Sphere &sphere : scene.spheres)
+        {
+            if (sphere.materialId < 1 || sphere.materialId > materialCount)
+            {
+                std::cerr << "Sphere " << sphere.id << " has no material " << sphere.materialId << std::endl;
+                return false;
+            }
+            if (sphere.center < 1 || sphere.center > vertexCount)
+            {
+                std::cerr << "Sphere " << sphere.id << " has no center vertex " << sphere.center << std::endl;
+                return false;
+            }
+        }
+        return validateAnimation(scene);
+    }
+}
+
+bool generateSceneFromXml(const std::string &fileName, Scene *scene)
+{
+    XMLDocument doc;
+    doc.LoadFile(fileName.c_str());
+
+    if (doc.Error())
+    {
+        std::cerr << "Error loading XML file: " << doc.ErrorStr() << std::endl;
+        return false;
+    }
+
+    *scene = Scene();
+    const XMLElement *sceneElement = doc.RootElement();
+    if (!sceneElement || tagOf(sceneElement->Name()) != Tag::Scene)
+    {
+        std::cerr << "No scene element in " << fileName << std::endl;
+        return false;
+    }
+
+    TransformationLibrary transformations;
+    std::vector<std::string> instanceTransformations;
+
+    // every element is visited once, in file order
+    for (const XMLElement *element = sceneElement->FirstChildElement(); element; element = element->NextSiblingElement())
+    {
+        switch (tagOf(element->Name()))
+        {
+        case Tag::MaxRayTraceDepth:
+            readNumber(element, scene->maxRayTraceDepth);
+            break;
+        case Tag::BackgroundColor:
+            readVector(element, scene->backgroundColor);
+            break;
+        case Tag::ShadowRayEpsilon:
+            readNumber(element, scene->shadowRayEpsilon);
+            break;
+        // either a cameras block with one camera element per view or a single camera element
+        case Tag::Cameras:
+            for (const XMLElement *cameraElement = element->FirstChildElement(); cameraElement; cameraElement = cameraElement->NextSiblingElement())
+            {
+                if (tagOf(cameraElement->Name()) == Tag::Camera)
+                {
+                    Camera camera = Camera();
+                    parseCamera(cameraElement, camera);
+                    scene->cameras.push_back(camera);
+                }
+            }
+            break;
+        case Tag::Camera:
+        {
+            Camera camera = Camera();
+            parseCamera(element, camera);
+            scene->cameras.push_back(camera);
+            break;
+        }
+        case Tag::Lights:
+            parseLights(element, scene);
+            break;
+        case Tag::Materials:
+            parseMaterials(element, scene);
+            break;
+        case Tag::VertexData:
+            parseVertexData(element->GetText(), scene->vertexData);
+            break;
+        case Tag::Transformations:
+            parseTransformations(element, transformations);
+            break;
+        case Tag::Objects:
+            parseObjects(element, scene, instanceTransformations);
+            break;
+        case Tag::Animation:
+            parseAnimation(element, scene->animation);
+            break;
+        default:
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < scene->meshInstances.size(); i++)
+    {
+        if (!resolveTransformations(instanceTransformations[i], transformations, scene->meshInstances[i].transform))
+        {
+            std::cerr << "Mesh instance " << scene->meshInstances[i].id << " refers to unknown transformations \""
+                      << instanceTransformations[i] << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    return validateScene(*scene);
+}
@@ -0,0 +1,13 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include <string>
+#include "SceneXmlModel.h"
+
+// loads a scene xml file into scene, returns false and reports the reason on std::cerr when it cannot.
+// element names are matched without regard to case, so the lowercase schema (scene, maxraytracedepth,
+// camera, materialid) and the capitalized one (Scene, MaxRecursionDepth, Cameras/Camera, Material)
+// are both accepted, and the synonyms of the two schemas map onto the same fields
+bool generateSceneFromXml(const std::string &fileName, Scene *scene);
+
+#endif // SCENELOADER_H
@@ -4,13 +4,16 @@
 #include <vector>
 #include <string>
 #include "Vector3.h"
+#include "Transform.h"
+
+class CompiledScene;
 
 class NearPlane {
 public:
-    double left;
-    double right;
-    double bottom;
-    double top;
+    Real left;
+    Real right;
+    Real bottom;
+    Real top;
 };
 
 class ImageResolution {
@@ -21,18 +24,28 @@ public:
 
 class Camera {
 public:
+    int id = 0;
     Vector3 position;
     Vector3 gaze;
     Vector3 up;
     NearPlane nearPlane;
-    double nearDistance;
+    Real nearDistance;
     ImageResolution imageResolution;
+    // samples per pixel requested by the scene, used as the adaptive sampling budget
+    int numSamples = 1;
+    // file the image of this camera is written to, empty when the scene does not name one
+    std::string imageName;
 
     // top left corner of the near plane
     Vector3 q;
     // u and v are the basis vectors of the near plane
     Vector3 v;
     Vector3 u;
+    // unnormalized direction through the center of the top left pixel, and the steps to the next pixel
+    // of a row and of a column
+    Vector3 firstPixel;
+    Vector3 pixelStepU;
+    Vector3 pixelStepV;
 };
 
 class PointLight {
@@ -48,7 +61,10 @@ public:
     Vector3 vertex1;
     Vector3 vertex2;
     Vector3 vertex3;
+    // radiant intensity per unit area, both sides of the triangle emit and a larger light gives more light
     Vector3 intensity;
+    // shadow rays per shaded point, rounded to a square number of strata
+    int numSamples = 16;
 };
 
 class Material {
@@ -61,24 +77,110 @@ public:
     int phongExponent;
 };
 
+// 1-based indices into Scene::vertexData
+class Face {
+public:
+    int vertex1;
+    int vertex2;
+    int vertex3;
+};
+
 class Mesh {
 public:
     int id;
     int materialId;
-    std::vector<Vector3> faces;
+    std::vector<Face> faces;
+    // a Triangle object, kept as a mesh of its one face. its id may be the id of a Mesh object as well
+    bool isTriangle = false;
+};
+
+// a copy of a mesh placed in the scene, rendered from the geometry of the mesh it refers to
+class MeshInstance {
+public:
+    int id;
+    // id of the mesh that is placed
+    int baseMeshId;
+    // replaces the material of the mesh, 0 keeps it
+    int materialId = 0;
+    // from the coordinates of the mesh to the scene
+    Transform transform;
+};
+
+class Sphere {
+public:
+    int id;
+    int materialId;
+    // 1-based index into Scene::vertexData
+    int center;
+    Real radius;
+};
+
+// pose of a camera at one frame of the animation
+class CameraKey {
+public:
+    int frame = 0;
+    Vector3 position;
+    Vector3 gaze;
+    Vector3 up;
+};
+
+// placement of a mesh or an instance at one frame: scaled, then rotated by angle degrees around axis,
+// then translated. between two keys each part is interpolated on its own, the rotation by quaternion slerp
+class ObjectKey {
+public:
+    int frame = 0;
+    Vector3 scaling = Vector3(1, 1, 1);
+    Real angle = 0;
+    Vector3 axis = Vector3(0, 1, 0);
+    Vector3 translation;
+};
+
+// keys of one camera, sorted by frame
+class CameraTrack {
+public:
+    int cameraId;
+    std::vector<CameraKey> keys;
+};
+
+// keys of one mesh or instance, sorted by frame. the key transform moves a mesh from where its
+// vertices are defined, and an instance from where its own transformations place it
+class ObjectTrack {
+public:
+    int objectId;
+    std::vector<ObjectKey> keys;
+};
+
+// keyframes rendered as a sequence of images in one run. before its first key and after its last
+// a track holds the pose of that key, cameras and objects without a track do not move
+class Animation {
+public:
+    // frames 0 up to frameCount - 1, 0 when the scene is not animated
+    int frameCount = 0;
+    std::vector<CameraTrack> cameraTracks;
+    std::vector<ObjectTrack> meshTracks;
+    std::vector<ObjectTrack> instanceTracks;
 };
 
 class Scene {
 public:
     int maxRayTraceDepth;
     Color3 backgroundColor;
-    Camera camera;
+    // offset applied to shadow ray origins along the surface normal
+    Real shadowRayEpsilon = 0.001;
+    // every camera is rendered into its own image
+    std::vector<Camera> cameras;
     std::vector<PointLight> pointLights;
     std::vector<TriangularLight> triangularLights;
     Vector3 ambientLight;
     std::vector<Material> materials;
     std::vector<Vector3> vertexData;
     std::vector<Mesh> meshes;
+    std::vector<MeshInstance> meshInstances;
+    std::vector<Sphere> spheres;
+    Animation animation;
+
+    // triangle and sphere buffers and acceleration structure built from the objects before rendering
+    const CompiledScene *compiled = nullptr;
 };
 
 #endif // SCENEXMLMODEL_H
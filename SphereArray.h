@@ -0,0 +1,100 @@
+#ifndef SPHEREARRAY_H
+#define SPHEREARRAY_H
+
+#include <cmath>
+#include <vector>
+#include "Intersection.h"
+
+// every sphere of the scene in structure-of-arrays form,
+// reordered by the BVH build so that each leaf covers a contiguous range
+class SphereArray {
+public:
+    std::vector<Real> centerX;
+    std::vector<Real> centerY;
+    std::vector<Real> centerZ;
+    std::vector<Real> radius;
+    std::vector<int> materialId;
+    std::vector<int> objectId;
+
+    int size() const
+    {
+        return radius.size();
+    }
+
+    Vector3 center(int i) const
+    {
+        return Vector3(centerX[i], centerY[i], centerZ[i]);
+    }
+
+    void clear()
+    {
+        *this = SphereArray();
+    }
+
+    void add(const Vector3 &center, Real sphereRadius, int sphereMaterialId, int sphereObjectId)
+    {
+        centerX.push_back(center.x);
+        centerY.push_back(center.y);
+        centerZ.push_back(center.z);
+        radius.push_back(sphereRadius);
+        materialId.push_back(sphereMaterialId);
+        objectId.push_back(sphereObjectId);
+    }
+
+    // sphere i of the result is sphere order[i] of this array
+    SphereArray reordered(const std::vector<int> &order) const
+    {
+        SphereArray result;
+        for (int i : order)
+        {
+            result.add(center(i), radius[i], materialId[i], objectId[i]);
+        }
+        return result;
+    }
+};
+
+// closest sphere in [first, first + count) hit with t < tMax, -1 when none is hit
+inline int intersectSpheres(const SphereArray &spheres, int first, int count, const Ray &ray, Real tMax, Real &t)
+{
+    int closestSphere = -1;
+    for (int i = first; i < first + count; i++)
+    {
+        Vector3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+        Real tSphere = sphereIntersection(ray, center, spheres.radius[i], tMax);
+        if (tSphere < tMax)
+        {
+            tMax = tSphere;
+            closestSphere = i;
+        }
+    }
+    t = tMax;
+    return closestSphere;
+}
+
+// true when any sphere in [first, first + count) is hit closer than tMax
+inline bool occludedBySpheres(const SphereArray &spheres, int first, int count, const Ray &ray, Real tMax)
+{
+    for (int i = first; i < first + count; i++)
+    {
+        Vector3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+        if (sphereIntersection(ray, center, spheres.radius[i], tMax) < tMax)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline Hit makeSphereHit(const Ray &ray, const SphereArray &spheres, int sphere, Real t)
+{
+    Hit hit;
+    hit.isHit = true;
+    hit.t = t;
+    hit.pointIntersects = findIntersectionPoint(ray, t);
+    hit.surfaceNormal = hit.pointIntersects - spheres.center(sphere);
+    hit.materialId = spheres.materialId[sphere];
+    hit.objectId = spheres.objectId[sphere];
+    return hit;
+}
+
+#endif // SPHEREARRAY_H
@@ -0,0 +1,122 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// fixed set of render threads that is started once and reused for every pass, camera and frame.
+// run() hands the same job to every worker and returns when all of them have finished it,
+// the job itself pulls its work from a TileScheduler. idle workers sleep on a condition variable.
+class ThreadPool {
+public:
+    // pinThreads binds worker i to cpu i modulo the number of cpus, where the platform supports it
+    ThreadPool(int threadCount, bool pinThreads)
+    {
+        for (int worker = 0; worker < threadCount; worker++)
+        {
+            threads.emplace_back(&ThreadPool::workerLoop, this, worker);
+            if (pinThreads)
+            {
+                pinThread(threads.back(), worker);
+            }
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int threadCount() const
+    {
+        return threads.size();
+    }
+
+    // calls job(worker) on every worker thread and waits for all of the calls to return
+    void run(const std::function<void(int)> &job)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        currentJob = &job;
+        busyWorkers = threads.size();
+        generation++;
+        wakeUp.notify_all();
+        finished.wait(lock, [this]
+                      { return busyWorkers == 0; });
+        currentJob = nullptr;
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    const std::function<void(int)> *currentJob = nullptr;
+    // incremented for every job, a worker runs a job once when it sees a new generation
+    uint64_t generation = 0;
+    int busyWorkers = 0;
+    bool stopping = false;
+
+    void workerLoop(int worker)
+    {
+        uint64_t seenGeneration = 0;
+        while (true)
+        {
+            const std::function<void(int)> *job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this, seenGeneration]
+                            { return stopping || generation != seenGeneration; });
+                if (stopping)
+                {
+                    return;
+                }
+                seenGeneration = generation;
+                job = currentJob;
+            }
+
+            (*job)(worker);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0)
+            {
+                finished.notify_one();
+            }
+        }
+    }
+
+    static void pinThread(std::thread &thread, int worker)
+    {
+#ifdef __linux__
+        int cpuCount = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker % cpuCount, &cpus);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus);
+#else
+        (void)thread;
+        (void)worker;
+#endif
+    }
+};
+
+#endif // THREADPOOL_H
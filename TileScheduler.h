@@ -0,0 +1,106 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// rectangular block of pixels, x1 and y1 are exclusive
+class Tile {
+public:
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// hands out image tiles to worker threads without locks.
+// tiles are sorted along a Morton curve and split into one contiguous range per worker,
+// so each worker renders neighbouring tiles. a worker that runs out of tiles steals
+// the next unrendered tile from the other ranges.
+class TileScheduler {
+public:
+    TileScheduler(int width, int height, int tileSize, int workerCount)
+        : workerCount(workerCount), queues(new WorkerQueue[workerCount])
+    {
+        for (int y = 0; y < height; y += tileSize)
+        {
+            for (int x = 0; x < width; x += tileSize)
+            {
+                Tile tile;
+                tile.x0 = x;
+                tile.y0 = y;
+                tile.x1 = std::min(x + tileSize, width);
+                tile.y1 = std::min(y + tileSize, height);
+                tiles.push_back(tile);
+            }
+        }
+
+        std::sort(tiles.begin(), tiles.end(), [tileSize](const Tile &a, const Tile &b)
+                  { return mortonCode(a.x0 / tileSize, a.y0 / tileSize) < mortonCode(b.x0 / tileSize, b.y0 / tileSize); });
+
+        int tileCount = tiles.size();
+        for (int w = 0; w < workerCount; w++)
+        {
+            queues[w].next = (long long)tileCount * w / workerCount;
+            queues[w].end = (long long)tileCount * (w + 1) / workerCount;
+        }
+    }
+
+    // next tile for the given worker, false when every tile has been handed out
+    bool nextTile(int worker, Tile &tile)
+    {
+        for (int i = 0; i < workerCount; i++)
+        {
+            WorkerQueue &queue = queues[(worker + i) % workerCount];
+            if (queue.next.load(std::memory_order_relaxed) >= queue.end)
+            {
+                continue;
+            }
+
+            int index = queue.next.fetch_add(1, std::memory_order_relaxed);
+            if (index < queue.end)
+            {
+                tile = tiles[index];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int tileCount() const
+    {
+        return tiles.size();
+    }
+
+private:
+    // own cache line per worker so claiming tiles does not cause false sharing
+    class alignas(64) WorkerQueue {
+    public:
+        std::atomic<int> next;
+        int end;
+    };
+
+    int workerCount;
+    std::vector<Tile> tiles;
+    std::unique_ptr<WorkerQueue[]> queues;
+
+    static uint32_t spreadBits(uint32_t v)
+    {
+        v &= 0xFFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    static uint32_t mortonCode(int x, int y)
+    {
+        return spreadBits(x) | (spreadBits(y) << 1);
+    }
+};
+
+#endif // TILESCHEDULER_H
@@ -0,0 +1,142 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <cmath>
+#include "Vector3.h"
+
+// affine transformation, p' = linear p + translation. the rows of the 3x4 matrix are stored,
+// the last column is the translation
+class Transform {
+public:
+    Real m[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+
+    static Transform translation(const Vector3 &offset)
+    {
+        Transform transform;
+        transform.m[0][3] = offset.x;
+        transform.m[1][3] = offset.y;
+        transform.m[2][3] = offset.z;
+        return transform;
+    }
+
+    static Transform scaling(const Vector3 &factors)
+    {
+        Transform transform;
+        transform.m[0][0] = factors.x;
+        transform.m[1][1] = factors.y;
+        transform.m[2][2] = factors.z;
+        return transform;
+    }
+
+    // counterclockwise rotation by angle degrees around axis, looking from the tip of the axis at the origin
+    static Transform rotation(Real angle, const Vector3 &axis)
+    {
+        Vector3 a = axis.normalize();
+        Real radians = angle * Real(M_PI / 180);
+        Real c = std::cos(radians);
+        Real s = std::sin(radians);
+        Real t = 1 - c;
+
+        Transform transform;
+        transform.m[0][0] = t * a.x * a.x + c;
+        transform.m[0][1] = t * a.x * a.y - s * a.z;
+        transform.m[0][2] = t * a.x * a.z + s * a.y;
+        transform.m[1][0] = t * a.x * a.y + s * a.z;
+        transform.m[1][1] = t * a.y * a.y + c;
+        transform.m[1][2] = t * a.y * a.z - s * a.x;
+        transform.m[2][0] = t * a.x * a.z - s * a.y;
+        transform.m[2][1] = t * a.y * a.z + s * a.x;
+        transform.m[2][2] = t * a.z * a.z + c;
+        return transform;
+    }
+
+    // the transformation applying other first and then this one
+    Transform operator*(const Transform &other) const
+    {
+        Transform result;
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                Real value = column == 3 ? m[row][3] : 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    value += m[row][k] * other.m[k][column];
+                }
+                result.m[row][column] = value;
+            }
+        }
+        return result;
+    }
+
+    bool operator==(const Transform &other) const
+    {
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                if (m[row][column] != other.m[row][column])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(const Transform &other) const
+    {
+        return !(*this == other);
+    }
+
+    Vector3 point(const Vector3 &p) const
+    {
+        return Vector3(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                       m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                       m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+
+    // directions ignore the translation
+    Vector3 vector(const Vector3 &v) const
+    {
+        return Vector3(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                       m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                       m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // v times the transposed linear part. normals are carried by the inverse transpose,
+    // so calling this on the inverse of a transformation carries normals through it
+    Vector3 transposedVector(const Vector3 &v) const
+    {
+        return Vector3(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                       m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                       m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+    }
+
+    // the rows of the inverse linear part are the cross products of its columns over the determinant.
+    // a singular transformation gives non finite values
+    Transform inverse() const
+    {
+        Vector3 column0(m[0][0], m[1][0], m[2][0]);
+        Vector3 column1(m[0][1], m[1][1], m[2][1]);
+        Vector3 column2(m[0][2], m[1][2], m[2][2]);
+        Vector3 row0 = cross(column1, column2);
+        Vector3 row1 = cross(column2, column0);
+        Vector3 row2 = cross(column0, column1);
+        Real inverseDeterminant = 1 / dot(column0, row0);
+
+        Transform result;
+        const Vector3 rows[3] = {row0 * inverseDeterminant, row1 * inverseDeterminant, row2 * inverseDeterminant};
+        Vector3 offset(m[0][3], m[1][3], m[2][3]);
+        for (int row = 0; row < 3; row++)
+        {
+            result.m[row][0] = rows[row].x;
+            result.m[row][1] = rows[row].y;
+            result.m[row][2] = rows[row].z;
+            result.m[row][3] = -dot(rows[row], offset);
+        }
+        return result;
+    }
+};
+
+#endif // TRANSFORM_H
@@ -0,0 +1,461 @@
+#ifndef TRIANGLESIMD_H
+#define TRIANGLESIMD_H
+
+#include <cmath>
+#include <vector>
+#include "Intersection.h"
+
+// one ray is tested against SIMD_WIDTH triangles at a time:
+// 8 lanes with AVX2, 4 lanes with SSE2 and a plain loop over 4 lanes otherwise.
+// RT_DISPATCH (the release build) uses 8 lanes written with compiler vector types instead,
+// the functions marked RT_MULTIVERSION are compiled once per instruction set and the
+// fastest one the cpu supports is picked when the program starts
+#if defined(RT_DISPATCH)
+#define SIMD_WIDTH 8
+#define RT_MULTIVERSION __attribute__((target_clones("avx2", "sse4.2", "default")))
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#else
+#define SIMD_WIDTH 4
+#endif
+
+#ifndef RT_MULTIVERSION
+#define RT_MULTIVERSION
+#endif
+
+// structure-of-arrays copy of up to SIMD_WIDTH compiled triangles,
+// unused lanes hold degenerate triangles that are never hit
+class alignas(32) TriangleBlock {
+public:
+    float vertexX[SIMD_WIDTH];
+    float vertexY[SIMD_WIDTH];
+    float vertexZ[SIMD_WIDTH];
+    float edge1X[SIMD_WIDTH];
+    float edge1Y[SIMD_WIDTH];
+    float edge1Z[SIMD_WIDTH];
+    float edge2X[SIMD_WIDTH];
+    float edge2Y[SIMD_WIDTH];
+    float edge2Z[SIMD_WIDTH];
+    // index into CompiledScene::triangles, -1 for unused lanes
+    int triangleIndex[SIMD_WIDTH];
+};
+
+// ray data broadcast once and reused for every block the ray is tested against
+class SimdRay {
+public:
+    float originX;
+    float originY;
+    float originZ;
+    float directionX;
+    float directionY;
+    float directionZ;
+
+    SimdRay(const Ray &ray)
+    {
+        originX = (float)ray.getOrigin().x;
+        originY = (float)ray.getOrigin().y;
+        originZ = (float)ray.getOrigin().z;
+        directionX = (float)ray.getDirection().x;
+        directionY = (float)ray.getDirection().y;
+        directionZ = (float)ray.getDirection().z;
+    }
+};
+
+// packs count triangles starting at first into blocks appended to the given vector
+inline void packTriangleBlocks(const std::vector<CompiledTriangle> &triangles, int first, int count, std::vector<TriangleBlock> &blocks)
+{
+    for (int i = 0; i < count; i += SIMD_WIDTH)
+    {
+        TriangleBlock block;
+        for (int lane = 0; lane < SIMD_WIDTH; lane++)
+        {
+            bool used = i + lane < count;
+            const CompiledTriangle *triangle = used ? &triangles[first + i + lane] : nullptr;
+
+            block.vertexX[lane] = used ? triangle->vertex.x : 0;
+            block.vertexY[lane] = used ? triangle->vertex.y : 0;
+            block.vertexZ[lane] = used ? triangle->vertex.z : 0;
+            block.edge1X[lane] = used ? triangle->edge1.x : 0;
+            block.edge1Y[lane] = used ? triangle->edge1.y : 0;
+            block.edge1Z[lane] = used ? triangle->edge1.z : 0;
+            block.edge2X[lane] = used ? triangle->edge2.x : 0;
+            block.edge2Y[lane] = used ? triangle->edge2.y : 0;
+            block.edge2Z[lane] = used ? triangle->edge2.z : 0;
+            block.triangleIndex[lane] = used ? first + i + lane : -1;
+        }
+        blocks.push_back(block);
+    }
+}
+
+#if defined(RT_DISPATCH)
+
+typedef float FloatLanes __attribute__((vector_size(SIMD_WIDTH * sizeof(float))));
+// comparisons of FloatLanes give -1 in the lanes where they hold and 0 elsewhere
+typedef int IntLanes __attribute__((vector_size(SIMD_WIDTH * sizeof(int))));
+
+inline bool anyLane(const IntLanes &mask)
+{
+    int any = 0;
+    for (int lane = 0; lane < SIMD_WIDTH; lane++)
+    {
+        any |= mask[lane];
+    }
+    return any != 0;
+}
+
+// Möller–Trumbore against every lane of the block, same tests and epsilons as triangleIntersection.
+// sets mask to the lanes hit with t < tMax and t to their distances, returns false when no lane is hit.
+// the vectors are passed by reference, they only live in registers once this is inlined into a caller
+inline bool intersectTriangleLanes(const SimdRay &ray, const TriangleBlock &block, float tMax, IntLanes &mask, FloatLanes &t)
+{
+    const float epsilon = 0.00001f;
+    const FloatLanes zero = {};
+
+    FloatLanes dx = zero + ray.directionX;
+    FloatLanes dy = zero + ray.directionY;
+    FloatLanes dz = zero + ray.directionZ;
+
+    FloatLanes e1x = *(const FloatLanes *)block.edge1X;
+    FloatLanes e1y = *(const FloatLanes *)block.edge1Y;
+    FloatLanes e1z = *(const FloatLanes *)block.edge1Z;
+    FloatLanes e2x = *(const FloatLanes *)block.edge2X;
+    FloatLanes e2y = *(const FloatLanes *)block.edge2Y;
+    FloatLanes e2z = *(const FloatLanes *)block.edge2Z;
+
+    // h = d x e2, a = e1 . h
+    FloatLanes hx = dy * e2z - dz * e2y;
+    FloatLanes hy = dz * e2x - dx * e2z;
+    FloatLanes hz = dx * e2y - dy * e2x;
+    FloatLanes a = e1x * hx + e1y * hy + e1z * hz;
+
+    mask = (a >= epsilon) | (a <= -epsilon);
+    if (!anyLane(mask))
+    {
+        return false;
+    }
+
+    FloatLanes f = 1.0f / a;
+
+    // s = o - vertex, u = f * (s . h)
+    FloatLanes sx = ray.originX - *(const FloatLanes *)block.vertexX;
+    FloatLanes sy = ray.originY - *(const FloatLanes *)block.vertexY;
+    FloatLanes sz = ray.originZ - *(const FloatLanes *)block.vertexZ;
+    FloatLanes u = f * (sx * hx + sy * hy + sz * hz);
+    mask &= (u >= 0.0f) & (u <= 1.0f);
+
+    // q = s x e1, v = f * (d . q)
+    FloatLanes qx = sy * e1z - sz * e1y;
+    FloatLanes qy = sz * e1x - sx * e1z;
+    FloatLanes qz = sx * e1y - sy * e1x;
+    FloatLanes v = f * (dx * qx + dy * qy + dz * qz);
+    mask &= (v >= 0.0f) & (u + v <= 1.0f);
+
+    // t = f * (e2 . q)
+    t = f * (e2x * qx + e2y * qy + e2z * qz);
+    mask &= (t > epsilon) & (t < tMax);
+    return anyLane(mask);
+}
+
+// when a lane is hit closer than tClosest, tClosest and triangleIndex are updated and true is returned
+inline bool intersectTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float &tClosest, int &triangleIndex)
+{
+    IntLanes mask;
+    FloatLanes t;
+    if (!intersectTriangleLanes(ray, block, tClosest, mask, t))
+    {
+        return false;
+    }
+
+    int closestLane = 0;
+    float tMin = INFINITY;
+    for (int lane = 0; lane < SIMD_WIDTH; lane++)
+    {
+        if (mask[lane] && t[lane] < tMin)
+        {
+            tMin = t[lane];
+            closestLane = lane;
+        }
+    }
+
+    tClosest = tMin;
+    triangleIndex = block.triangleIndex[closestLane];
+    return true;
+}
+
+// true when any lane is hit closer than tMax
+inline bool occludedByTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float tMax)
+{
+    IntLanes mask;
+    FloatLanes t;
+    return intersectTriangleLanes(ray, block, tMax, mask, t);
+}
+
+#elif defined(__AVX2__)
+
+// horizontal minimum, every lane of the result holds it
+inline __m256 horizontalMin(__m256 x)
+{
+    x = _mm256_min_ps(x, _mm256_permute2f128_ps(x, x, 1));
+    x = _mm256_min_ps(x, _mm256_shuffle_ps(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm256_min_ps(x, _mm256_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return x;
+}
+
+// Möller–Trumbore against every lane of the block, same tests and epsilons as triangleIntersection.
+// returns the mask of lanes hit with t < tMax and their distances in t
+inline __m256 intersectTriangleLanes(const SimdRay &ray, const TriangleBlock &block, float tMax, __m256 &t)
+{
+    const __m256 epsilon = _mm256_set1_ps(0.00001f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 dx = _mm256_set1_ps(ray.directionX);
+    __m256 dy = _mm256_set1_ps(ray.directionY);
+    __m256 dz = _mm256_set1_ps(ray.directionZ);
+
+    __m256 e1x = _mm256_load_ps(block.edge1X);
+    __m256 e1y = _mm256_load_ps(block.edge1Y);
+    __m256 e1z = _mm256_load_ps(block.edge1Z);
+    __m256 e2x = _mm256_load_ps(block.edge2X);
+    __m256 e2y = _mm256_load_ps(block.edge2Y);
+    __m256 e2z = _mm256_load_ps(block.edge2Z);
+
+    // h = d x e2, a = e1 . h
+    __m256 hx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    __m256 hy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    __m256 hz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, hx), _mm256_mul_ps(e1y, hy)), _mm256_mul_ps(e1z, hz));
+
+    __m256 absA = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+    __m256 mask = _mm256_cmp_ps(absA, epsilon, _CMP_GE_OQ);
+    if (_mm256_movemask_ps(mask) == 0)
+    {
+        return mask;
+    }
+
+    __m256 f = _mm256_div_ps(one, a);
+
+    // s = o - vertex, u = f * (s . h)
+    __m256 sx = _mm256_sub_ps(_mm256_set1_ps(ray.originX), _mm256_load_ps(block.vertexX));
+    __m256 sy = _mm256_sub_ps(_mm256_set1_ps(ray.originY), _mm256_load_ps(block.vertexY));
+    __m256 sz = _mm256_sub_ps(_mm256_set1_ps(ray.originZ), _mm256_load_ps(block.vertexZ));
+    __m256 u = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, hx), _mm256_mul_ps(sy, hy)), _mm256_mul_ps(sz, hz)));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+
+    // q = s x e1, v = f * (d . q)
+    __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    __m256 v = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+
+    // t = f * (e2 . q)
+    t = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, epsilon, _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+    return mask;
+}
+
+// when a lane is hit closer than tClosest, tClosest and triangleIndex are updated and true is returned
+inline bool intersectTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float &tClosest, int &triangleIndex)
+{
+    __m256 t;
+    __m256 mask = intersectTriangleLanes(ray, block, tClosest, t);
+    if (_mm256_movemask_ps(mask) == 0)
+    {
+        return false;
+    }
+
+    t = _mm256_blendv_ps(_mm256_set1_ps(INFINITY), t, mask);
+    __m256 tMin = horizontalMin(t);
+    int lane = __builtin_ctz(_mm256_movemask_ps(_mm256_cmp_ps(t, tMin, _CMP_EQ_OQ)));
+
+    tClosest = _mm256_cvtss_f32(tMin);
+    triangleIndex = block.triangleIndex[lane];
+    return true;
+}
+
+// true when any lane is hit closer than tMax
+inline bool occludedByTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float tMax)
+{
+    __m256 t;
+    return _mm256_movemask_ps(intersectTriangleLanes(ray, block, tMax, t)) != 0;
+}
+
+#elif defined(__SSE2__)
+
+// horizontal minimum, every lane of the result holds it
+inline __m128 horizontalMin(__m128 x)
+{
+    x = _mm_min_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_min_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return x;
+}
+
+// Möller–Trumbore against every lane of the block, same tests and epsilons as triangleIntersection.
+// returns the mask of lanes hit with t < tMax and their distances in t
+inline __m128 intersectTriangleLanes(const SimdRay &ray, const TriangleBlock &block, float tMax, __m128 &t)
+{
+    const __m128 epsilon = _mm_set1_ps(0.00001f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 dx = _mm_set1_ps(ray.directionX);
+    __m128 dy = _mm_set1_ps(ray.directionY);
+    __m128 dz = _mm_set1_ps(ray.directionZ);
+
+    __m128 e1x = _mm_load_ps(block.edge1X);
+    __m128 e1y = _mm_load_ps(block.edge1Y);
+    __m128 e1z = _mm_load_ps(block.edge1Z);
+    __m128 e2x = _mm_load_ps(block.edge2X);
+    __m128 e2y = _mm_load_ps(block.edge2Y);
+    __m128 e2z = _mm_load_ps(block.edge2Z);
+
+    // h = d x e2, a = e1 . h
+    __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+
+    __m128 absA = _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+    __m128 mask = _mm_cmpge_ps(absA, epsilon);
+    if (_mm_movemask_ps(mask) == 0)
+    {
+        return mask;
+    }
+
+    __m128 f = _mm_div_ps(one, a);
+
+    // s = o - vertex, u = f * (s . h)
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.originX), _mm_load_ps(block.vertexX));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.originY), _mm_load_ps(block.vertexY));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.originZ), _mm_load_ps(block.vertexZ));
+    __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(u, one));
+
+    // q = s x e1, v = f * (d . q)
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+
+    // t = f * (e2 . q)
+    t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, epsilon));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(tMax)));
+    return mask;
+}
+
+// when a lane is hit closer than tClosest, tClosest and triangleIndex are updated and true is returned
+inline bool intersectTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float &tClosest, int &triangleIndex)
+{
+    __m128 t;
+    __m128 mask = intersectTriangleLanes(ray, block, tClosest, t);
+    if (_mm_movemask_ps(mask) == 0)
+    {
+        return false;
+    }
+
+    t = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, _mm_set1_ps(INFINITY)));
+    __m128 tMin = horizontalMin(t);
+    int lane = __builtin_ctz(_mm_movemask_ps(_mm_cmpeq_ps(t, tMin)));
+
+    tClosest = _mm_cvtss_f32(tMin);
+    triangleIndex = block.triangleIndex[lane];
+    return true;
+}
+
+// true when any lane is hit closer than tMax
+inline bool occludedByTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float tMax)
+{
+    __m128 t;
+    return _mm_movemask_ps(intersectTriangleLanes(ray, block, tMax, t)) != 0;
+}
+
+#else
+
+inline bool intersectTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float &tClosest, int &triangleIndex)
+{
+    bool found = false;
+    for (int lane = 0; lane < SIMD_WIDTH; lane++)
+    {
+        float hx = ray.directionY * block.edge2Z[lane] - ray.directionZ * block.edge2Y[lane];
+        float hy = ray.directionZ * block.edge2X[lane] - ray.directionX * block.edge2Z[lane];
+        float hz = ray.directionX * block.edge2Y[lane] - ray.directionY * block.edge2X[lane];
+        float a = block.edge1X[lane] * hx + block.edge1Y[lane] * hy + block.edge1Z[lane] * hz;
+        if (a > -0.00001f && a < 0.00001f)
+        {
+            continue;
+        }
+
+        float f = 1.0f / a;
+        float sx = ray.originX - block.vertexX[lane];
+        float sy = ray.originY - block.vertexY[lane];
+        float sz = ray.originZ - block.vertexZ[lane];
+        float u = f * (sx * hx + sy * hy + sz * hz);
+        if (u < 0.0f || u > 1.0f)
+        {
+            continue;
+        }
+
+        float qx = sy * block.edge1Z[lane] - sz * block.edge1Y[lane];
+        float qy = sz * block.edge1X[lane] - sx * block.edge1Z[lane];
+        float qz = sx * block.edge1Y[lane] - sy * block.edge1X[lane];
+        float v = f * (ray.directionX * qx + ray.directionY * qy + ray.directionZ * qz);
+        if (v < 0.0f || u + v > 1.0f)
+        {
+            continue;
+        }
+
+        float t = f * (block.edge2X[lane] * qx + block.edge2Y[lane] * qy + block.edge2Z[lane] * qz);
+        if (t > 0.00001f && t < tClosest)
+        {
+            tClosest = t;
+            triangleIndex = block.triangleIndex[lane];
+            found = true;
+        }
+    }
+    return found;
+}
+
+// true when any lane is hit closer than tMax
+inline bool occludedByTriangleBlock(const SimdRay &ray, const TriangleBlock &block, float tMax)
+{
+    int triangleIndex;
+    return intersectTriangleBlock(ray, block, tMax, triangleIndex);
+}
+
+#endif
+
+// fills in the hit record for the triangle found by intersectTriangleBlock
+inline Hit makeTriangleHit(const Ray &ray, const CompiledTriangle &triangle, Real t)
+{
+#ifdef RT_DOUBLE
+    // the block kernels work in float, the double path recomputes the hit on the chosen triangle
+    Hit exact = triangleIntersection(ray, triangle, (Real)INFINITY);
+    if (exact.isHit)
+    {
+        return exact;
+    }
+#endif
+
+    Hit hit;
+    hit.isHit = true;
+    hit.t = t;
+    hit.pointIntersects = findIntersectionPoint(ray, t);
+    hit.surfaceNormal = cross(triangle.edge1, triangle.edge2);
+    hit.materialId = triangle.materialId;
+    hit.objectId = triangle.objectId;
+    return hit;
+}
+
+#endif // TRIANGLESIMD_H
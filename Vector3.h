@@ -4,29 +4,40 @@
 #include <iostream>
 #include <cmath>
 
-class Vector3
+// scalar type of the renderer. float is the default,
+// building with -DRT_DOUBLE (make PRECISION=double) gives the double precision path used for validation
+#ifdef RT_DOUBLE
+typedef double Real;
+#else
+typedef float Real;
+#endif
+
+template <typename T>
+class Vector3T
 {
 public:
-    double x;
-    double y;
-    double z;
+    typedef T Scalar;
 
-    Vector3() : x(0), y(0), z(0) {}
+    T x;
+    T y;
+    T z;
 
-    Vector3(double x, double y, double z) : x(x), y(y), z(z) {}
+    Vector3T() : x(0), y(0), z(0) {}
 
-    double length() const
+    Vector3T(T x, T y, T z) : x(x), y(y), z(z) {}
+
+    T length() const
     {
-        return sqrt(x * x + y * y + z * z);
+        return std::sqrt(x * x + y * y + z * z);
     }
 
-    Vector3 normalize() const
+    Vector3T normalize() const
     {
-        double length = sqrt(x * x + y * y + z * z);
-        return Vector3(x / length, y / length, z / length);
+        T length = std::sqrt(x * x + y * y + z * z);
+        return Vector3T(x / length, y / length, z / length);
     }
 
-    Vector3 &operator+=(const Vector3 &v)
+    Vector3T &operator+=(const Vector3T &v)
     {
         x += v.x;
         y += v.y;
@@ -34,7 +45,7 @@ public:
         return *this;
     }
 
-    Vector3 &operator*=(double t)
+    Vector3T &operator*=(T t)
     {
         x *= t;
         y *= t;
@@ -42,67 +53,81 @@ public:
         return *this;
     }
 
-    Vector3 operator-() const
+    Vector3T operator-() const
     {
-        return Vector3(-x, -y, -z);
+        return Vector3T(-x, -y, -z);
     }
 
-    Vector3 &operator/= (double t) {
+    Vector3T &operator/= (T t) {
         return *this *= 1/t;
     }
 
 
 };
 
+typedef Vector3T<Real> Vector3;
+
 // use vector3 as Color
 using Color3 = Vector3;
 
-inline Vector3 operator*(double t, const Vector3 &v)
+// the scalar argument is taken as Vector3T<T>::Scalar so that double constants can scale a float vector
+
+template <typename T>
+inline Vector3T<T> operator*(typename Vector3T<T>::Scalar t, const Vector3T<T> &v)
 {
-    return Vector3(t * v.x, t * v.y, t * v.z);
+    return Vector3T<T>(t * v.x, t * v.y, t * v.z);
 }
 
-inline Vector3 operator*(const Vector3 &v, double t)
+template <typename T>
+inline Vector3T<T> operator*(const Vector3T<T> &v, typename Vector3T<T>::Scalar t)
 {
     return t * v;
 }
 
-inline Vector3 operator*(const Vector3 &a, const Vector3 &b)
+template <typename T>
+inline Vector3T<T> operator*(const Vector3T<T> &a, const Vector3T<T> &b)
 {
-    return Vector3(a.x * b.x, a.y * b.y, a.z * b.z);
+    return Vector3T<T>(a.x * b.x, a.y * b.y, a.z * b.z);
 }
 
-inline double dot(const Vector3 &a, const Vector3 &b)
+template <typename T>
+inline T dot(const Vector3T<T> &a, const Vector3T<T> &b)
 {
     return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
-inline Vector3 operator+(const Vector3 &a, const Vector3 &b)
+template <typename T>
+inline Vector3T<T> operator+(const Vector3T<T> &a, const Vector3T<T> &b)
 {
-    return Vector3(a.x + b.x, a.y + b.y, a.z + b.z);
+    return Vector3T<T>(a.x + b.x, a.y + b.y, a.z + b.z);
 }
 
-inline Vector3 operator-(const Vector3 &a, const Vector3 &b)
+template <typename T>
+inline Vector3T<T> operator-(const Vector3T<T> &a, const Vector3T<T> &b)
 {
-    return Vector3(a.x - b.x, a.y - b.y, a.z - b.z);
+    return Vector3T<T>(a.x - b.x, a.y - b.y, a.z - b.z);
 }
 
-inline Vector3 cross(const Vector3& u, const Vector3& v) {
-    return Vector3(u.y * v.z - u.z * v.y,
+template <typename T>
+inline Vector3T<T> cross(const Vector3T<T>& u, const Vector3T<T>& v) {
+    return Vector3T<T>(u.y * v.z - u.z * v.y,
                    u.z * v.x - u.x * v.z,
                    u.x * v.y - u.y * v.x);
 }
 
-inline Vector3 operator/(const Vector3& v, double t) {
+template <typename T>
+inline Vector3T<T> operator/(const Vector3T<T>& v, typename Vector3T<T>::Scalar t) {
     return (1/t) * v;
 }
 
 //unit vector
-inline Vector3 unitVector(const Vector3& v) {
+template <typename T>
+inline Vector3T<T> unitVector(const Vector3T<T>& v) {
     return v / v.length();
 }
 
-double determinant(const Vector3& a, const Vector3& b, const Vector3& c) {
+template <typename T>
+inline T determinant(const Vector3T<T>& a, const Vector3T<T>& b, const Vector3T<T>& c) {
     return a.x * (b.y * c.z - b.z * c.y) -
            a.y * (b.x * c.z - b.z * c.x) +
            a.z * (b.x * c.y - b.y * c.x);
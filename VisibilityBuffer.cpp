@@ -0,0 +1,196 @@
+#include "VisibilityBuffer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // doubled signed area of (a, b, p), positive when p is left of the edge from a to b
+    Real edgeFunction(Real ax, Real ay, Real bx, Real by, Real px, Real py)
+    {
+        return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+    }
+
+    // first and last pixel whose center lies in [low, high], clipped to [0, size - 1]
+    void pixelRange(Real low, Real high, int size, int &first, int &last)
+    {
+        // clamped before the conversion, points close to the eye project far outside the image
+        first = (int)std::ceil(std::max<Real>(-1, std::min<Real>(size, low - Real(0.5))));
+        last = (int)std::floor(std::max<Real>(-1, std::min<Real>(size, high - Real(0.5))));
+        first = std::max(first, 0);
+        last = std::min(last, size - 1);
+    }
+}
+
+void VisibilityBuffer::setup(const Camera &camera, const std::vector<CompiledTriangle> &triangles, int tileSize)
+{
+    width = camera.imageResolution.nx;
+    height = camera.imageResolution.ny;
+    this->tileSize = tileSize;
+    tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+
+    projected.clear();
+    bins.assign((size_t)tilesX * tilesY, std::vector<int>());
+
+    // the ray through image point (x, y) has the direction c + x U + y V, so a point at e + a (c + x U + y V)
+    // is found by solving rel = a c + (a x) U + (a y) V with the rows of the inverse of [c U V]
+    const Vector3 &U = camera.pixelStepU;
+    const Vector3 &V = camera.pixelStepV;
+    Vector3 c = camera.q - camera.position;
+    eye = camera.position;
+    corner = c;
+    stepU = U;
+    stepV = V;
+    rowA = cross(U, V);
+    rowX = cross(V, c);
+    rowY = cross(c, U);
+    determinant = dot(c, rowA);
+    if (determinant == 0)
+    {
+        return;
+    }
+
+    for (size_t t = 0; t < triangles.size(); t++)
+    {
+        const CompiledTriangle &triangle = triangles[t];
+        Vector3 vertices[3] = {triangle.vertex, triangle.vertex + triangle.edge1, triangle.vertex + triangle.edge2};
+        addTriangle(vertices, t);
+    }
+}
+
+void VisibilityBuffer::addTriangle(const Vector3 *vertices, int triangleIndex)
+{
+    // a is 1 on the near plane, the part of the triangle closer to the eye than minimumA is clipped away.
+    // anything in that part is still found by the trace that verifies the rasterized hit
+    const Real minimumA = Real(0.01);
+
+    // the ray through (x, y) meets the plane of the triangle at a = n.(vertex - e) / n.(c + x U + y V).
+    // 1 / a is taken from the plane itself rather than interpolated between the projected corners,
+    // which lose their precision when a corner is close to the eye
+    Vector3 normal = cross(vertices[1] - vertices[0], vertices[2] - vertices[0]);
+    Real planeDistance = dot(normal, vertices[0] - eye);
+    // seen edge on, the rays along its plane are left to the ray tracer
+    if (planeDistance == 0)
+    {
+        return;
+    }
+    Real depthPlane[3] = {dot(normal, corner) / planeDistance, dot(normal, stepU) / planeDistance, dot(normal, stepV) / planeDistance};
+
+    Real a[3];
+    int inFront = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        a[k] = dot(vertices[k] - eye, rowA) / determinant;
+        inFront += a[k] >= minimumA;
+    }
+    if (inFront == 0)
+    {
+        return;
+    }
+
+    // the clipped polygon has three or four corners
+    Vector3 polygon[4];
+    int corners = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        int next = (k + 1) % 3;
+        if (a[k] >= minimumA)
+        {
+            polygon[corners++] = vertices[k];
+        }
+        if ((a[k] >= minimumA) != (a[next] >= minimumA))
+        {
+            Real s = (minimumA - a[k]) / (a[next] - a[k]);
+            polygon[corners++] = vertices[k] + s * (vertices[next] - vertices[k]);
+        }
+    }
+
+    // fan of triangles around the first corner, they share the plane so 1 / a still varies linearly
+    for (int k = 1; k + 1 < corners; k++)
+    {
+        const Vector3 fan[3] = {polygon[0], polygon[k], polygon[k + 1]};
+
+        ProjectedTriangle p;
+        p.triangleIndex = triangleIndex;
+        for (int v = 0; v < 3; v++)
+        {
+            Vector3 rel = fan[v] - eye;
+            Real depth = std::max(minimumA, dot(rel, rowA) / determinant);
+            p.x[v] = dot(rel, rowX) / determinant / depth;
+            p.y[v] = dot(rel, rowY) / determinant / depth;
+            p.depthPlane[v] = depthPlane[v];
+        }
+
+        pixelRange(std::min({p.x[0], p.x[1], p.x[2]}), std::max({p.x[0], p.x[1], p.x[2]}), width, p.minI, p.maxI);
+        pixelRange(std::min({p.y[0], p.y[1], p.y[2]}), std::max({p.y[0], p.y[1], p.y[2]}), height, p.minJ, p.maxJ);
+        if (p.minI > p.maxI || p.minJ > p.maxJ)
+        {
+            continue;
+        }
+
+        int index = projected.size();
+        projected.push_back(p);
+        for (int ty = p.minJ / tileSize; ty <= p.maxJ / tileSize; ty++)
+        {
+            for (int tx = p.minI / tileSize; tx <= p.maxI / tileSize; tx++)
+            {
+                bins[(size_t)ty * tilesX + tx].push_back(index);
+            }
+        }
+    }
+}
+
+void VisibilityBuffer::rasterize(const Tile &tile, std::vector<int> &triangleIds) const
+{
+    int tileWidth = tile.x1 - tile.x0;
+    int tileHeight = tile.y1 - tile.y0;
+    triangleIds.assign((size_t)tileWidth * tileHeight, -1);
+    if (bins.empty())
+    {
+        return;
+    }
+
+    // inverse depth of the closest triangle so far, 0 is infinitely far away
+    std::vector<Real> closest((size_t)tileWidth * tileHeight, 0);
+
+    for (int index : bins[(size_t)(tile.y0 / tileSize) * tilesX + tile.x0 / tileSize])
+    {
+        const ProjectedTriangle &p = projected[index];
+        Real area = edgeFunction(p.x[0], p.y[0], p.x[1], p.y[1], p.x[2], p.y[2]);
+        // seen edge on, the rays along its plane are left to the ray tracer
+        if (area == 0)
+        {
+            continue;
+        }
+
+        int minI = std::max(p.minI, tile.x0);
+        int maxI = std::min(p.maxI, tile.x1 - 1);
+        int minJ = std::max(p.minJ, tile.y0);
+        int maxJ = std::min(p.maxJ, tile.y1 - 1);
+        for (int j = minJ; j <= maxJ; j++)
+        {
+            Real py = j + Real(0.5);
+            for (int i = minI; i <= maxI; i++)
+            {
+                Real px = i + Real(0.5);
+
+                // barycentric coordinates, the edge functions of the opposite edges over the area
+                Real w0 = edgeFunction(p.x[1], p.y[1], p.x[2], p.y[2], px, py) / area;
+                Real w1 = edgeFunction(p.x[2], p.y[2], p.x[0], p.y[0], px, py) / area;
+                Real w2 = edgeFunction(p.x[0], p.y[0], p.x[1], p.y[1], px, py) / area;
+                if (w0 < 0 || w1 < 0 || w2 < 0)
+                {
+                    continue;
+                }
+
+                Real inverseDepth = p.depthPlane[0] + p.depthPlane[1] * px + p.depthPlane[2] * py;
+                size_t pixel = (size_t)(j - tile.y0) * tileWidth + (i - tile.x0);
+                if (inverseDepth > closest[pixel])
+                {
+                    closest[pixel] = inverseDepth;
+                    triangleIds[pixel] = p.triangleIndex;
+                }
+            }
+        }
+    }
+}
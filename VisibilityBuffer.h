@@ -0,0 +1,60 @@
+#ifndef VISIBILITYBUFFER_H
+#define VISIBILITYBUFFER_H
+
+#include <vector>
+#include "Intersection.h"
+#include "SceneXmlModel.h"
+#include "TileScheduler.h"
+
+// triangle projected to the image, in pixels measured from the top left corner
+class ProjectedTriangle {
+public:
+    Real x[3];
+    Real y[3];
+    // 1 / depth at pixel coordinates (x, y) is depthPlane[0] + depthPlane[1] x + depthPlane[2] y
+    Real depthPlane[3];
+    // pixels whose centers lie inside the projected bounding box, clipped to the image
+    int minI;
+    int maxI;
+    int minJ;
+    int maxJ;
+    int triangleIndex;
+};
+
+// primary visibility of one camera found by rasterizing the triangles instead of tracing the primary rays.
+// the triangles are projected and sorted into the tiles they cover once, then every tile is rasterized
+// on its own by the worker that renders it
+class VisibilityBuffer {
+public:
+    // projects the triangles in front of the camera and bins them into tiles of tileSize pixels,
+    // cameraSetup has to run first
+    void setup(const Camera &camera, const std::vector<CompiledTriangle> &triangles, int tileSize);
+
+    // index of the closest triangle covering the center of every pixel of the tile, -1 where none does.
+    // written row by row, the rows are tile.x1 - tile.x0 long
+    void rasterize(const Tile &tile, std::vector<int> &triangleIds) const;
+
+private:
+    // clips the triangle to the part in front of the eye, projects it and adds it to the bins it covers
+    void addTriangle(const Vector3 *vertices, int triangleIndex);
+
+    // projection set up by setup(), see there
+    Vector3 eye;
+    Vector3 corner;
+    Vector3 stepU;
+    Vector3 stepV;
+    Vector3 rowA;
+    Vector3 rowX;
+    Vector3 rowY;
+    Real determinant = 0;
+
+    int width = 0;
+    int height = 0;
+    int tileSize = 1;
+    int tilesX = 0;
+    std::vector<ProjectedTriangle> projected;
+    // indices into projected for every tile, row by row
+    std::vector<std::vector<int>> bins;
+};
+
+#endif // VISIBILITYBUFFER_H
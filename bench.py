@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Benchmark driver used by make bench.
+
+Renders every scene in sample_scenes/ at each of the given fixed resolutions, which
+replace the resolution of the scene's cameras, and with each of the given thread counts.
+Every run is repeated and the median and spread of the render time and ray throughput
+are reported. The microbenchmarks of bench_micro are run as well.
+
+With --save-baseline the results are stored as the baseline. Otherwise they are
+compared against the stored baseline, and the script exits with status 1 when the
+throughput of a scene drops, or a microbenchmark slows down, by more than the tolerance.
+"""
+
+import argparse
+import glob
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+
+def median_and_spread(values):
+    median = statistics.median(values)
+    # median absolute deviation, relative to the median
+    mad = statistics.median([abs(v - median) for v in values])
+    return median, (mad / median if median else 0.0)
+
+
+def run_scene(scene, resolution, threads, runs, workdir):
+    renders = []
+    throughputs = []
+    stats_name = os.path.join(workdir, "stats.json")
+    # the first run writes the scene cache so the timed runs do not include parsing
+    for run in range(runs + 1):
+        result = subprocess.run(
+            ["./main", scene, "-o", os.path.join(workdir, "bench.ppm"),
+             "--resolution", str(resolution[0]), str(resolution[1]),
+             "--threads", str(threads), "--stats-json", stats_name],
+            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        if result.returncode != 0:
+            lines = result.stderr.strip().splitlines()
+            return None, lines[-1] if lines else "exit status %d" % result.returncode
+        if run == 0:
+            continue
+        with open(stats_name) as stats_file:
+            stats = json.load(stats_file)
+        renders.append(stats["phases"]["render"])
+        throughputs.append(stats["mraysPerSecond"])
+
+    render, render_spread = median_and_spread(renders)
+    throughput, throughput_spread = median_and_spread(throughputs)
+    return {
+        "renderSeconds": render,
+        "renderSpread": render_spread,
+        "mraysPerSecond": throughput,
+        "mraysSpread": throughput_spread,
+    }, None
+
+
+def run_micro(runs, workdir):
+    json_name = os.path.join(workdir, "micro.json")
+    subprocess.run(["./bench_micro", "--repetitions", str(max(runs, 3)), "--json", json_name], check=True)
+    with open(json_name) as micro_file:
+        return json.load(micro_file)
+
+
+def compare(results, baseline, tolerance):
+    regressions = []
+    for key, base in baseline.get("scenes", {}).items():
+        current = results["scenes"].get(key)
+        if current is None:
+            regressions.append("%s: no longer renders" % key)
+        elif current["mraysPerSecond"] < base["mraysPerSecond"] * (1 - tolerance):
+            regressions.append("%s: %.3f Mrays/s, baseline %.3f" % (key, current["mraysPerSecond"], base["mraysPerSecond"]))
+    for name, base in baseline.get("micro", {}).items():
+        current = results["micro"].get(name)
+        if current is not None and current["medianNs"] > base["medianNs"] * (1 + tolerance):
+            regressions.append("%s: %.2f ns/op, baseline %.2f" % (name, current["medianNs"], base["medianNs"]))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--resolutions", default="256x256 512x512", help="space separated widthxheight image sizes")
+    parser.add_argument("--threads", default="1", help="space separated thread counts")
+    parser.add_argument("--tolerance", type=float, default=0.1, help="allowed relative slowdown")
+    parser.add_argument("--baseline", default="bench_baseline.json")
+    parser.add_argument("--save-baseline", action="store_true")
+    parser.add_argument("--scenes", default="sample_scenes/*.xml")
+    args = parser.parse_args()
+
+    resolutions = [tuple(int(n) for n in r.lower().split("x")) for r in args.resolutions.split()]
+
+    results = {"scenes": {}, "micro": {}}
+    with tempfile.TemporaryDirectory() as workdir:
+        print("%-32s %10s %8s %12s %8s %10s %8s" % ("scene", "resolution", "threads", "render s", "spread", "Mrays/s", "spread"))
+        for scene in sorted(glob.glob(args.scenes)):
+            for resolution in resolutions:
+                size = "%dx%d" % resolution
+                for threads in [int(t) for t in args.threads.split()]:
+                    key = "%s@%s@%d" % (os.path.basename(scene), size, threads)
+                    result, error = run_scene(scene, resolution, threads, args.runs, workdir)
+                    if result is None:
+                        print("%-32s %10s %8d   failed: %s" % (os.path.basename(scene), size, threads, error))
+                        continue
+                    results["scenes"][key] = result
+                    print("%-32s %10s %8d %12.4f %7.1f%% %10.3f %7.1f%%" % (
+                        os.path.basename(scene), size, threads, result["renderSeconds"], 100 * result["renderSpread"],
+                        result["mraysPerSecond"], 100 * result["mraysSpread"]))
+
+        print()
+        results["micro"] = run_micro(args.runs, workdir)
+
+    if args.save_baseline:
+        with open(args.baseline, "w") as baseline_file:
+            json.dump(results, baseline_file, indent=2, sort_keys=True)
+        print("\nBaseline saved to %s" % args.baseline)
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print("\nNo baseline at %s, run make bench-baseline to store one" % args.baseline)
+        return 0
+
+    with open(args.baseline) as baseline_file:
+        baseline = json.load(baseline_file)
+    regressions = compare(results, baseline, args.tolerance)
+    if regressions:
+        print("\nRegressions beyond %.0f%%:" % (100 * args.tolerance))
+        for regression in regressions:
+            print("  " + regression)
+        return 1
+
+    print("\nNo regressions beyond %.0f%% against %s" % (100 * args.tolerance, args.baseline))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,221 @@
+// microbenchmarks of the hot per ray and per image routines, run by make bench
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "CameraRays.h"
+#include "Intersection.h"
+#include "ppm.h"
+
+namespace
+{
+    // the results are folded into this so the compiler cannot drop the benchmarked work
+    volatile double sink;
+
+    class BenchResult {
+    public:
+        std::string name;
+        double medianNs;
+        double minNs;
+        double maxNs;
+    };
+
+    // runs batch repetitions times, each batch performs operations operations, and reports ns per operation
+    BenchResult runBenchmark(const std::string &name, int repetitions, long operations, const std::function<double()> &batch)
+    {
+        std::vector<double> samples;
+        for (int r = 0; r < repetitions; r++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            sink = sink + batch();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+            samples.push_back(elapsed.count() / operations);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        BenchResult result;
+        result.name = name;
+        result.medianNs = samples[samples.size() / 2];
+        result.minNs = samples.front();
+        result.maxNs = samples.back();
+        return result;
+    }
+
+    // deterministic values in [-1, 1)
+    Real pseudoRandom(unsigned &state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (Real(2) / 16777216) - 1;
+    }
+
+    Camera benchCamera(int width, int height)
+    {
+        Camera camera;
+        camera.position = Vector3(0, 0, 0);
+        camera.gaze = Vector3(0, 0, -1);
+        camera.up = Vector3(0, 1, 0);
+        camera.nearPlane.left = -1;
+        camera.nearPlane.right = 1;
+        camera.nearPlane.bottom = -1;
+        camera.nearPlane.top = 1;
+        camera.nearDistance = 1;
+        camera.imageResolution.nx = width;
+        camera.imageResolution.ny = height;
+        cameraSetup(camera);
+        return camera;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string jsonName;
+    int repetitions = 9;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc)
+        {
+            jsonName = argv[++i];
+        }
+        else if (arg == "--repetitions" && i + 1 < argc)
+        {
+            repetitions = std::max(1, std::stoi(argv[++i]));
+        }
+    }
+
+    std::vector<BenchResult> results;
+
+    // triangleIntersection, every ray against every triangle of a small random soup
+    {
+        const int triangleCount = 256;
+        const int rayCount = 256;
+        unsigned state = 1;
+        std::vector<CompiledTriangle> triangles(triangleCount);
+        for (CompiledTriangle &triangle : triangles)
+        {
+            triangle.vertex = Vector3(pseudoRandom(state), pseudoRandom(state), pseudoRandom(state) - 3);
+            triangle.edge1 = Vector3(pseudoRandom(state), pseudoRandom(state), pseudoRandom(state));
+            triangle.edge2 = Vector3(pseudoRandom(state), pseudoRandom(state), pseudoRandom(state));
+            triangle.materialId = 1;
+            triangle.objectId = 1;
+        }
+        std::vector<Ray> rays;
+        for (int i = 0; i < rayCount; i++)
+        {
+            Vector3 direction(pseudoRandom(state) * Real(0.3), pseudoRandom(state) * Real(0.3), -1);
+            rays.push_back(Ray(Vector3(0, 0, 0), direction.normalize()));
+        }
+
+        results.push_back(runBenchmark("triangleIntersection", repetitions, (long)triangleCount * rayCount, [&]()
+                                       {
+            double sum = 0;
+            for (const Ray &ray : rays)
+            {
+                for (const CompiledTriangle &triangle : triangles)
+                {
+                    Hit hit = triangleIntersection(ray, triangle, (Real)INFINITY);
+                    sum += hit.isHit ? hit.t : 0;
+                }
+            }
+            return sum; }));
+
+        // sphereIntersection, every ray against spheres placed on the same triangle soup
+        results.push_back(runBenchmark("sphereIntersection", repetitions, (long)triangleCount * rayCount, [&]()
+                                       {
+            double sum = 0;
+            for (const Ray &ray : rays)
+            {
+                for (const CompiledTriangle &triangle : triangles)
+                {
+                    Real t = sphereIntersection(ray, triangle.vertex, Real(0.1), (Real)INFINITY);
+                    sum += t != INFINITY ? t : 0;
+                }
+            }
+            return sum; }));
+    }
+
+    // calculateRay and generateRowRays for every pixel of a 1024x1024 image
+    {
+        const int width = 1024;
+        const int height = 1024;
+        Camera camera = benchCamera(width, height);
+
+        results.push_back(runBenchmark("calculateRay", repetitions, (long)width * height, [&]()
+                                       {
+            double sum = 0;
+            for (int j = 0; j < height; j++)
+            {
+                for (int i = 0; i < width; i++)
+                {
+                    sum += calculateRay(camera, i, j).getDirection().x;
+                }
+            }
+            return sum; }));
+
+        // the same rays generated a row at a time
+        results.push_back(runBenchmark("generateRowRays", repetitions, (long)width * height, [&]()
+                                       {
+            double sum = 0;
+            CameraRayBatch batch;
+            for (int j = 0; j < height; j++)
+            {
+                for (int i = 0; i < width; i += RAY_BATCH_SIZE)
+                {
+                    generateRowRays(camera, i, j, RAY_BATCH_SIZE, batch);
+                    sum += batch.directionX[0];
+                }
+            }
+            return sum; }));
+    }
+
+    // write_ppm of a 1024x1024 image, reported per image
+    {
+        const int width = 1024;
+        const int height = 1024;
+        std::vector<unsigned char> image((size_t)width * height * 3);
+        for (size_t i = 0; i < image.size(); i++)
+        {
+            image[i] = i * 31;
+        }
+        const char *fileName = "bench_micro.ppm";
+
+        // write_ppm reports every saved image, that output is not part of the benchmark
+        std::streambuf *coutBuffer = std::cout.rdbuf(nullptr);
+        results.push_back(runBenchmark("write_ppm", repetitions, 1, [&]()
+                                       {
+            write_ppm(fileName, image.data(), width, height);
+            return 0.0; }));
+        std::cout.rdbuf(coutBuffer);
+        std::cout.clear();
+        std::remove(fileName);
+    }
+
+    for (const BenchResult &result : results)
+    {
+        std::printf("%-22s median %12.2f ns/op   min %12.2f   max %12.2f\n", result.name.c_str(), result.medianNs, result.minNs, result.maxNs);
+    }
+
+    if (!jsonName.empty())
+    {
+        std::ofstream out(jsonName);
+        out << "{" << std::endl;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchResult &result = results[i];
+            out << "  \"" << result.name << "\": {\"medianNs\": " << result.medianNs << ", \"minNs\": " << result.minNs
+                << ", \"maxNs\": " << result.maxNs << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+        }
+        out << "}" << std::endl;
+        if (!out)
+        {
+            std::cerr << "Results could not be written to " << jsonName << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -1,169 +1,111 @@
-#include "tinyxml2.h"
 #include <iostream>
 #include <string>
-#include <sstream>
 #include "SceneXmlModel.h"
 #include <memory>
 #include "ppm.h"
 #include "Ray.h"
+#include "Intersection.h"
+#include "CompiledScene.h"
+#include "TileScheduler.h"
+#include "ThreadPool.h"
+#include "RenderStats.h"
+#include "SceneCache.h"
+#include "CameraRays.h"
+#include "SceneLoader.h"
+#include "RayPacket.h"
+#include "VisibilityBuffer.h"
+#include "Animation.h"
 #include <chrono>
 #include <thread>
+#include <atomic>
 
-using namespace tinyxml2;
-
-typedef struct Hit
-{
-    bool isHit;
-    Vector3 surfaceNormal;
-    int materialId;
-    float t;
-    Vector3 pointIntersects;
-    int objectId;
-} hit;
-
-float findDistance(const Vector3 &a, const Vector3 &b)
-{
-    return sqrt(pow(a.x - b.x, 2) + pow(a.y - b.y, 2) + pow(a.z - b.z, 2));
-}
-
-void cameraSetup(Camera &camera)
-{
-    int width = camera.imageResolution.nx;
-    int height = camera.imageResolution.ny;
-
-    // m = e + (gaze* distance)
-    Vector3 m = camera.position + (camera.gaze * camera.nearDistance);
-    Vector3 w = -1 * camera.gaze;
-
-    // q = m + (left * u) + (top * v)
-    camera.v = camera.up;
-    camera.u = cross(camera.v, w);
-    camera.q = m + camera.nearPlane.left * camera.u + camera.nearPlane.top * camera.v;
-}
-
-Ray calculateRay(const Camera &camera, int i, int j)
+Real findDistance(const Vector3 &a, const Vector3 &b)
 {
-    // S = q + SuU - SvV
-    float Su = (camera.nearPlane.right - camera.nearPlane.left) * (i + 0.5) / camera.imageResolution.nx;
-    float Sv = (camera.nearPlane.top - camera.nearPlane.bottom) * (j + 0.5) / camera.imageResolution.ny;
-    Vector3 SuU = Su * camera.u;
-    Vector3 SvV = Sv * camera.v;
-
-    Vector3 S = camera.q + SuU - SvV;
-
-    // r(t) = e + (s-e)t
-    Vector3 direction = S - camera.position;
-    direction = direction.normalize();
-
-    Ray ray = Ray(camera.position, direction);
-    return ray;
+    return (a - b).length();
 }
 
-Vector3 findIntersectionPoint(const Ray &ray, float t)
+// instances are traced after the rest of the scene and only replace a strictly closer hit,
+// the same way in every primary visibility mode
+Hit closerInstanceHit(const CompiledScene &compiled, const Ray &ray, const Hit &hit)
 {
-    Vector3 result;
-    Vector3 rayOrigin = ray.getOrigin();
-    Vector3 rayDirection = ray.getDirection();
-
-    result.x = rayOrigin.x + t * rayDirection.x;
-    result.y = rayOrigin.y + t * rayDirection.y;
-    result.z = rayOrigin.z + t * rayDirection.z;
+    if (compiled.instances.nodes.empty())
+    {
+        return hit;
+    }
 
-    return result;
+    Hit instanceHit = compiled.instances.intersect(ray, hit.isHit ? hit.t : (Real)INFINITY);
+    return instanceHit.isHit ? instanceHit : hit;
 }
 
-Hit triangleIntersection(const Ray &ray, const Vector3 &a, const Vector3 &b, const Vector3 &c, int materialId, int objectId)
+RT_MULTIVERSION Hit intersectWithObject(const Scene &scene, const Ray &ray)
 {
-    // a, b, c are vertices of the triangle
-    // determine if the ray intersects with the triangle using baricentric coordinates
-    Hit hit;
-    hit.isHit = false;
-
-    // edge vectors
-    Vector3 e1 = b - a;
-    Vector3 e2 = c - a;
-
-    Vector3 h = cross(ray.getDirection(), e2);
-    float a_ = dot(e1, h);
+    const CompiledScene &compiled = *scene.compiled;
 
-    if (a_ > -0.00001 && a_ < 0.00001)
+    if (!compiled.bvh.nodes.empty())
     {
-        return hit;
+        return closerInstanceHit(compiled, ray, compiled.bvh.intersect(compiled.triangles, compiled.spheres, ray));
     }
 
-    float f = 1.0 / a_;
-    Vector3 s = ray.getOrigin() - a;
-    float u = f * dot(s, h);
+    Hit closestHit;
+    closestHit.isHit = false;
 
-    if (u < 0.0 || u > 1.0)
-    {
-        return hit;
-    }
-    Vector3 q = cross(s, e1);
-    float v = f * dot(ray.getDirection(), q);
+    // hits that are not closer than the best one so far are rejected inside the kernel
+    SimdRay simdRay(ray);
+    float tClosest = INFINITY;
+    int closestTriangle = -1;
 
-    if (v < 0.0 || u + v > 1.0)
+    // search every triangle block
+    for (const TriangleBlock &block : compiled.blocks)
     {
-        return hit;
+        intersectTriangleBlock(simdRay, block, tClosest, closestTriangle);
     }
+    threadRayCounters.triangleTests += compiled.blocks.size() * SIMD_WIDTH;
 
-    float t = f * dot(e2, q);
+    // then every sphere, only hits closer than the closest triangle count
+    Real tSphere;
+    int closestSphere = intersectSpheres(compiled.spheres, 0, compiled.spheres.size(), ray, tClosest, tSphere);
+    threadRayCounters.sphereTests += compiled.spheres.size();
 
-    if (t > 0.00001)
+    if (closestSphere != -1)
+    {
+        closestHit = makeSphereHit(ray, compiled.spheres, closestSphere, tSphere);
+    }
+    else if (closestTriangle != -1)
     {
-        hit.isHit = true;
-        hit.t = t;
-        hit.pointIntersects = findIntersectionPoint(ray, t);
-        hit.surfaceNormal = cross(e1, e2);
-        hit.materialId = materialId;
-        hit.objectId = objectId;
+        closestHit = makeTriangleHit(ray, compiled.triangles[closestTriangle], tClosest);
     }
 
-    return hit;
+    return closerInstanceHit(compiled, ray, closestHit);
 }
 
-Hit intersectWithObject(const Scene &scene, const Ray &ray)
+// any-hit query for shadow rays, only tells whether something is hit before tMax
+RT_MULTIVERSION bool occluded(const Scene &scene, const Ray &ray, Real tMax)
 {
-    Mesh mesh;
-    int numberOfMeshes = scene.meshes.size();
+    const CompiledScene &compiled = *scene.compiled;
+    threadRayCounters.shadowRays++;
 
-    std::vector<Hit> hitV;
-    for (int i = 0; i < numberOfMeshes; i++)
+    if (compiled.instances.occluded(ray, tMax))
     {
-        mesh = scene.meshes[i];
-
-        // search every triangle
-        for (int j = 0; j < mesh.faces.size(); j++)
-        {
-            Vector3 vertex1 = scene.vertexData[mesh.faces[j].x - 1];
-            Vector3 vertex2 = scene.vertexData[mesh.faces[j].y - 1];
-            Vector3 vertex3 = scene.vertexData[mesh.faces[j].z - 1];
-
-            Hit hit = triangleIntersection(ray, vertex1, vertex2, vertex3, mesh.materialId, mesh.id);
-            if (hit.isHit && hit.t >= 0)
-            {
-                hitV.push_back(hit);
-            }
-        }
+        return true;
     }
 
-    Hit closestHit;
-    closestHit.isHit = false;
+    if (!compiled.bvh.nodes.empty())
+    {
+        return compiled.bvh.occluded(compiled.spheres, ray, tMax);
+    }
 
-    if (hitV.size() != 0)
+    SimdRay simdRay(ray);
+    for (const TriangleBlock &block : compiled.blocks)
     {
-        closestHit = hitV[0];
-        for (int i = 1; i < hitV.size(); i++)
+        threadRayCounters.triangleTests += SIMD_WIDTH;
+        if (occludedByTriangleBlock(simdRay, block, tMax))
         {
-            if (hitV[i].t < closestHit.t)
-            {
-                closestHit = hitV[i];
-            }
+            return true;
         }
-        closestHit.isHit = true;
     }
 
-    return closestHit;
+    threadRayCounters.sphereTests += compiled.spheres.size();
+    return occludedBySpheres(compiled.spheres, 0, compiled.spheres.size(), ray, tMax);
 }
 
 void debugScene(Scene &scene)
@@ -174,13 +116,18 @@ void debugScene(Scene &scene)
     // print everything to see if it is working
     std::cout << "maxRayTraceDepth: " << scene.maxRayTraceDepth << std::endl;
     std::cout << "backgroundColor: " << scene.backgroundColor.x << " " << scene.backgroundColor.y << " " << scene.backgroundColor.z << std::endl;
-    std::cout << "camera position: " << scene.camera.position.x << " " << scene.camera.position.y << " " << scene.camera.position.z << std::endl;
-    std::cout << "camera gaze: " << scene.camera.gaze.x << " " << scene.camera.gaze.y << " " << scene.camera.gaze.z << std::endl;
-    std::cout << "camera up: " << scene.camera.up.x << " " << scene.camera.up.y << " " << scene.camera.up.z << std::endl;
-    std::cout << "camera nearPlane: " << scene.camera.nearPlane.left << " " << scene.camera.nearPlane.right << " " << scene.camera.nearPlane.bottom << " " << scene.camera.nearPlane.top << std::endl;
-    std::cout << "camera nearDistance: " << scene.camera.nearDistance << std::endl;
-    std::cout << "camera imageResolution: " << scene.camera.imageResolution.nx << " " << scene.camera.imageResolution.ny << std::endl
-              << std::endl;
+    for (const Camera &camera : scene.cameras)
+    {
+        std::cout << "camera id: " << camera.id << std::endl;
+        std::cout << "camera position: " << camera.position.x << " " << camera.position.y << " " << camera.position.z << std::endl;
+        std::cout << "camera gaze: " << camera.gaze.x << " " << camera.gaze.y << " " << camera.gaze.z << std::endl;
+        std::cout << "camera up: " << camera.up.x << " " << camera.up.y << " " << camera.up.z << std::endl;
+        std::cout << "camera nearPlane: " << camera.nearPlane.left << " " << camera.nearPlane.right << " " << camera.nearPlane.bottom << " " << camera.nearPlane.top << std::endl;
+        std::cout << "camera nearDistance: " << camera.nearDistance << std::endl;
+        std::cout << "camera imageResolution: " << camera.imageResolution.nx << " " << camera.imageResolution.ny << std::endl;
+        std::cout << "camera imageName: " << camera.imageName << std::endl
+                  << std::endl;
+    }
 
     // print lights
     std::cout << "ambientLight: " << scene.ambientLight.x << " " << scene.ambientLight.y << " " << scene.ambientLight.z << std::endl;
@@ -197,6 +144,7 @@ void debugScene(Scene &scene)
         std::cout << "triangularLight vertex2: " << triangularLight.vertex2.x << " " << triangularLight.vertex2.y << " " << triangularLight.vertex2.z << std::endl;
         std::cout << "triangularLight vertex3: " << triangularLight.vertex3.x << " " << triangularLight.vertex3.y << " " << triangularLight.vertex3.z << std::endl;
         std::cout << "triangularLight intensity: " << triangularLight.intensity.x << " " << triangularLight.intensity.y << " " << triangularLight.intensity.z << std::endl;
+        std::cout << "triangularLight numSamples: " << triangularLight.numSamples << std::endl;
     }
 
     // print materials
@@ -230,493 +178,996 @@ void debugScene(Scene &scene)
             if (i < 1)
             {
                 std::cout << "face " << i++ << ": ";
-                std::cout << face.x << " " << face.y << " " << face.z << std::endl;
+                std::cout << face.vertex1 << " " << face.vertex2 << " " << face.vertex3 << std::endl;
             }
         }
     }
+    for (const Sphere &sphere : scene.spheres)
+    {
+        std::cout << "sphere id: " << sphere.id << std::endl;
+        std::cout << "sphere materialId: " << sphere.materialId << std::endl;
+        std::cout << "sphere center: " << sphere.center << std::endl;
+        std::cout << "sphere radius: " << sphere.radius << std::endl;
+    }
 }
 
-void generateSceneFromXml(std::string fileName, Scene *scene)
+// normal of the hit surface, flipped so that it faces the incoming ray
+Vector3 facingNormal(const Hit &hitResult, const Ray &ray)
 {
-    XMLDocument doc;
-    doc.LoadFile(fileName.c_str());
+    Vector3 normal = hitResult.surfaceNormal.normalize();
+    if (dot(normal, ray.getDirection()) > 0)
+    {
+        normal = -normal;
+    }
+    return normal;
+}
 
-    if (doc.Error())
+// whether anything in the scene may block a ray running inside the volume, false only when nothing can.
+// scenes without a BVH are not searched and always may
+bool mayBlock(const Scene &scene, const ShadowVolume &volume)
+{
+    const CompiledScene &compiled = *scene.compiled;
+    if (compiled.bvh.nodes.empty() && (!compiled.triangles.empty() || compiled.spheres.size() > 0))
     {
-        std::cerr << "Error loading XML file: " << doc.ErrorStr() << std::endl;
-        return;
+        return true;
     }
+    return compiled.instances.overlaps(volume) || compiled.bvh.overlaps(compiled.triangles, compiled.spheres, volume);
+}
 
-    // Access scene
-    XMLElement *sceneElement = doc.FirstChildElement("scene");
+// diffuse and specular light reflected towards toCamera from a point source, without the shadow test
+Vector3 pointLightContribution(const Material &material, const Vector3 &normal, const Vector3 &toCamera, const Vector3 &toLight, Real lightDistance, const Vector3 &intensity)
+{
+    Real cosTheta = dot(normal, toLight);
 
-    if (sceneElement)
-    {
-        scene->maxRayTraceDepth = sceneElement->FirstChildElement("maxraytracedepth")->IntText();
+    // irradiance E = I / d^2
+    Vector3 irradiance = intensity / (lightDistance * lightDistance);
 
-        auto bgElement = sceneElement->FirstChildElement("backgroundColor");
-        if (bgElement)
-        {
-            const char *bgText = bgElement->GetText();
-            if (bgText)
-            {
-                std::istringstream iss(bgText);
-                iss >> scene->backgroundColor.x >> scene->backgroundColor.y >> scene->backgroundColor.z;
-            }
-        }
+    // diffuse
+    // I = kd * cos(theta) * E
+    Vector3 diffuse = cosTheta * (material.diffuse * irradiance);
+
+    // specular, blinn-phong
+    // I = ks * cos(alpha)^p * E, alpha is the angle between the normal and the half vector
+    Vector3 halfVector = (toLight + toCamera).normalize();
+    Real cosAlpha = std::max<Real>(0, dot(normal, halfVector));
+    Vector3 specular = pow(cosAlpha, material.phongExponent) * (material.specular * irradiance);
+
+    return diffuse + specular;
+}
+
+// point on a triangular light for the stratum (sx, sy) of a strata x strata grid.
+// the square is warped onto the triangle with b = (1 - sqrt(u), sqrt(u) * v), which keeps the strata equal in area
+Vector3 triangularLightSample(const TriangularLight &light, int sx, int sy, int strata)
+{
+    Real u = (sx + Real(0.5)) / strata;
+    Real v = (sy + Real(0.5)) / strata;
+    Real su = std::sqrt(u);
+    Real b1 = 1 - su;
+    Real b2 = su * v;
+    return b1 * light.vertex1 + b2 * light.vertex2 + (1 - b1 - b2) * light.vertex3;
+}
+
+// light reaching the point from a triangular light, which is sampled as strata x strata point sources.
+// each stands for an equal share of the area and emits the light's intensity per unit area times that share,
+// scaled by the cosine at the emitter, so E = I * sum(A / n * cos(theta) * cos(theta_light) / d^2)
+Vector3 triangularLightContribution(const Scene &scene, const TriangularLight &light, const Material &material, const Vector3 &point, const Vector3 &normal, const Vector3 &toCamera)
+{
+    Vector3 lightCross = cross(light.vertex2 - light.vertex1, light.vertex3 - light.vertex1);
+    Real lightArea = lightCross.length() / 2;
+    if (lightArea <= 0)
+    {
+        return Vector3();
     }
 
-    // Access camera
-    XMLElement *cameraElement = sceneElement->FirstChildElement("camera");
-    if (cameraElement)
+    int strata = std::max(1, (int)round(sqrt(light.numSamples)));
+    int sampleCount = strata * strata;
+    Vector3 lightNormal = lightCross / (2 * lightArea);
+    Vector3 origin = point + scene.shadowRayEpsilon * normal;
+
+    // early accept. a shadow ray runs from the origin to its sample moved by the same offset as the origin,
+    // so every ray stays inside the tetrahedron spanned by the origin and the moved light. when no primitive
+    // bounds touch it no ray can be blocked and the per sample rays are skipped, which never changes the result
+    bool testEachSample = true;
+    if (sampleCount > 1)
     {
+        Vector3 offset = origin - point;
+        testEachSample = mayBlock(scene, ShadowVolume(origin, light.vertex1 + offset, light.vertex2 + offset, light.vertex3 + offset));
+    }
 
-        scene->camera.position = Vector3();
-        scene->camera.gaze = Vector3();
-        scene->camera.up = Vector3();
-        scene->camera.imageResolution = ImageResolution();
-        scene->camera.nearPlane = NearPlane();
-        auto positionElement = cameraElement->FirstChildElement("position");
-        if (positionElement)
+    Vector3 sampleIntensity = light.intensity * (lightArea / sampleCount);
+    Vector3 color;
+    for (int sy = 0; sy < strata; sy++)
+    {
+        for (int sx = 0; sx < strata; sx++)
         {
-            const char *positionText = positionElement->GetText();
-            if (positionText)
+            Vector3 toLight = triangularLightSample(light, sx, sy, strata) - point;
+            Real lightDistance = toLight.length();
+            toLight = toLight / lightDistance;
+
+            Real cosTheta = dot(normal, toLight);
+            Real cosLight = std::fabs(dot(lightNormal, toLight));
+            if (cosTheta <= 0 || cosLight <= 0)
             {
-                std::istringstream iss(positionText);
-                iss >> scene->camera.position.x >> scene->camera.position.y >> scene->camera.position.z;
+                continue;
             }
-        }
 
-        auto gazeElement = cameraElement->FirstChildElement("gaze");
-        if (gazeElement)
-        {
-            const char *gazeText = gazeElement->GetText();
-            if (gazeText)
+            if (testEachSample && occluded(scene, Ray(origin, toLight), lightDistance))
             {
-                std::istringstream iss(gazeText);
-                iss >> scene->camera.gaze.x >> scene->camera.gaze.y >> scene->camera.gaze.z;
+                continue;
             }
+
+            color += pointLightContribution(material, normal, toCamera, toLight, lightDistance, cosLight * sampleIntensity);
         }
+    }
+    return color;
+}
 
-        auto upElement = cameraElement->FirstChildElement("up");
-        if (upElement)
+// ambient, diffuse and specular light reflected towards the ray origin, without mirror reflection
+Vector3 shadeSurface(const Scene &scene, const Hit &hitResult, const Ray &ray)
+{
+    int materialId = hitResult.materialId;
+    const Material &material = scene.materials[materialId - 1];
+
+    // ambient light
+    // I = ka * Ia
+    // Ia = ambient light
+    // ka = ambient coef of the material
+    Vector3 color = material.ambient * scene.ambientLight;
+
+    const Vector3 &point = hitResult.pointIntersects;
+    Vector3 toCamera = -ray.getDirection();
+
+    // shade both sides of a triangle, the normal always faces the viewer
+    Vector3 normal = facingNormal(hitResult, ray);
+
+    for (const PointLight &light : scene.pointLights)
+    {
+        Vector3 toLight = light.position - point;
+        Real lightDistance = toLight.length();
+        toLight = toLight / lightDistance;
+
+        if (dot(normal, toLight) <= 0)
         {
-            const char *upText = upElement->GetText();
-            if (upText)
-            {
-                std::istringstream iss(upText);
-                iss >> scene->camera.up.x >> scene->camera.up.y >> scene->camera.up.z;
-            }
+            continue;
         }
 
-        auto nearPlaneElement = cameraElement->FirstChildElement("nearPlane");
-        if (nearPlaneElement)
+        // shadow ray starts slightly above the surface so it does not hit the surface itself
+        Ray shadowRay(point + scene.shadowRayEpsilon * normal, toLight);
+        if (occluded(scene, shadowRay, lightDistance))
         {
-            const char *nearPlaneText = nearPlaneElement->GetText();
-            if (nearPlaneText)
-            {
-                std::istringstream iss(nearPlaneText);
-                iss >> scene->camera.nearPlane.left >>
-                    scene->camera.nearPlane.right >>
-                    scene->camera.nearPlane.bottom >>
-                    scene->camera.nearPlane.top;
-            }
+            continue;
         }
 
-        auto nearDistanceElement = cameraElement->FirstChildElement("neardistance");
-        if (nearDistanceElement)
+        color += pointLightContribution(material, normal, toCamera, toLight, lightDistance, light.intensity);
+    }
+
+    for (const TriangularLight &light : scene.triangularLights)
+    {
+        color += triangularLightContribution(scene, light, material, point, normal, toCamera);
+    }
+
+    return color;
+}
+
+// reflected light is scaled by the product of the mirror reflectances along the path,
+// once every channel of that weight is below this a saturated surface changes the pixel by less than half a level
+const Real MIN_THROUGHPUT = Real(1) / 512;
+
+Vector3 findPixelColor(const Scene &scene, const Hit &hitResult, const Camera &currentCamera, const Ray &ray, int maxDepth)
+{
+    // if no hit
+    if (!hitResult.isHit)
+    {
+        return scene.backgroundColor;
+    }
+
+    // mirror reflections are followed iteratively, each bounce adds its surface color
+    // weighted by the mirror reflectances of the surfaces before it
+    Vector3 pixelColor;
+    Vector3 throughput(1, 1, 1);
+    Hit hit = hitResult;
+    Ray currentRay = ray;
+
+    for (int depth = 0;; depth++)
+    {
+        pixelColor += throughput * shadeSurface(scene, hit, currentRay);
+
+        const Vector3 &mirror = scene.materials[hit.materialId - 1].mirrorReflectance;
+        throughput = throughput * mirror;
+        if (depth >= maxDepth || std::max(throughput.x, std::max(throughput.y, throughput.z)) < MIN_THROUGHPUT)
         {
-            scene->camera.nearDistance = nearDistanceElement->DoubleText();
+            break;
         }
 
-        auto imageResolutionElement = cameraElement->FirstChildElement("imageresolution");
-        if (imageResolutionElement)
+        // wr = d - 2 (n . d) n
+        Vector3 normal = facingNormal(hit, currentRay);
+        const Vector3 &direction = currentRay.getDirection();
+        Vector3 reflected = (direction - 2 * dot(normal, direction) * normal).normalize();
+        currentRay = Ray(hit.pointIntersects + scene.shadowRayEpsilon * normal, reflected);
+
+        // reflected rays that leave the scene add nothing
+        threadRayCounters.reflectionRays++;
+        hit = intersectWithObject(scene, currentRay);
+        if (!hit.isHit)
         {
-            const char *imageResolutionText = imageResolutionElement->GetText();
-            if (imageResolutionText)
-            {
-                std::istringstream iss(imageResolutionText);
-                iss >> scene->camera.imageResolution.nx >> scene->camera.imageResolution.ny;
-            }
+            break;
         }
     }
 
-    // Access lights
-    XMLElement *lightsElement = sceneElement->FirstChildElement("lights");
-    if (lightsElement)
+    return pixelColor;
+}
+
+unsigned char clampColor(Real value)
+{
+    return std::round(std::min<Real>(255, std::max<Real>(0, value)));
+}
+
+Color3 tracePrimaryRay(const Scene &scene, const Camera &camera, const Ray &ray)
+{
+    threadRayCounters.primaryRays++;
+    Hit hit = intersectWithObject(scene, ray);
+
+    return findPixelColor(scene, hit, camera, ray, scene.maxRayTraceDepth);
+}
+
+Color3 tracePixelSample(const Scene &scene, const Camera &camera, Real x, Real y)
+{
+    return tracePrimaryRay(scene, camera, calculateRay(camera, x, y));
+}
+
+RT_MULTIVERSION void renderTile(const Scene &scene, const Camera &camera, const Tile &tile, unsigned char *image)
+{
+    int width = camera.imageResolution.nx;
+    CameraRayBatch batch;
+
+    for (int j = tile.y0; j < tile.y1; j++)
     {
-        // ambient light
-        auto ambientLightElement = lightsElement->FirstChildElement("ambientlight");
-        if (ambientLightElement)
+        for (int x = tile.x0; x < tile.x1; x += RAY_BATCH_SIZE)
         {
-            scene->ambientLight = Vector3();
-            const char *ambientLightText = ambientLightElement->GetText();
-            if (ambientLightText)
+            generateRowRays(camera, x, j, std::min(RAY_BATCH_SIZE, tile.x1 - x), batch);
+
+            for (int k = 0; k < batch.count; k++)
             {
-                std::istringstream iss(ambientLightText);
-                iss >> scene->ambientLight.x >> scene->ambientLight.y >> scene->ambientLight.z;
+                Color3 pixelColor = tracePrimaryRay(scene, camera, batch.ray(k));
+
+                int pixelNumber = ((j * width) + x + k) * 3;
+                image[pixelNumber] = clampColor(pixelColor.x);
+                image[pixelNumber + 1] = clampColor(pixelColor.y);
+                image[pixelNumber + 2] = clampColor(pixelColor.z);
             }
         }
+    }
+}
 
-        // point lights
-        XMLElement *pointLightElement = lightsElement->FirstChildElement("pointlight");
-        scene->pointLights = std::vector<PointLight>();
-        while (pointLightElement)
-        {
-            PointLight pointLight = PointLight();
-            pointLight.position = Vector3();
-            pointLight.intensity = Vector3();
-            pointLightElement->QueryIntAttribute("id", &pointLight.id);
+// hit record of ray r of a packet traced through the BVH
+Hit packetHit(const Scene &scene, const RayPacket &packet, int r)
+{
+    const CompiledScene &compiled = *scene.compiled;
+    int g = r / PACKET_LANES;
+    int lane = r % PACKET_LANES;
+    int primitive = packet.primitive[g][lane];
 
-            auto positionElement = pointLightElement->FirstChildElement("position");
-            if (positionElement)
-            {
-                const char *positionText = positionElement->GetText();
-                if (positionText)
-                {
-                    std::istringstream iss(positionText);
-                    iss >> pointLight.position.x >> pointLight.position.y >> pointLight.position.z;
-                }
-            }
+    Hit hit;
+    hit.isHit = false;
+    if (primitive >= 0)
+    {
+        hit = makeTriangleHit(packet.rays[r], compiled.triangles[primitive], packet.t[g][lane]);
+    }
+    else if (primitive < -1)
+    {
+        hit = makeSphereHit(packet.rays[r], compiled.spheres, -2 - primitive, packet.t[g][lane]);
+    }
 
-            auto intensityElement = pointLightElement->FirstChildElement("intensity");
-            if (intensityElement)
-            {
-                const char *intensityText = intensityElement->GetText();
-                if (intensityText)
-                {
-                    std::istringstream iss(intensityText);
-                    iss >> pointLight.intensity.x >> pointLight.intensity.y >> pointLight.intensity.z;
-                }
-            }
+    return closerInstanceHit(compiled, packet.rays[r], hit);
+}
 
-            scene->pointLights.push_back(pointLight);
-            pointLightElement = pointLightElement->NextSiblingElement("pointlight");
-        }
+// same image as renderTile, the primary rays are traced in PACKET_SIZE x PACKET_SIZE packets
+// and only the shading and the secondary rays are traced one ray at a time
+RT_MULTIVERSION void renderTilePackets(const Scene &scene, const Camera &camera, const Tile &tile, unsigned char *image)
+{
+    const CompiledScene &compiled = *scene.compiled;
+    int width = camera.imageResolution.nx;
+    RayPacket packet;
+    CameraRayBatch batch;
 
-        // triangular lights
-        XMLElement *triangularLightElement = lightsElement->FirstChildElement("triangularlight");
-        scene->triangularLights = std::vector<TriangularLight>();
-        while (triangularLightElement)
+    for (int y = tile.y0; y < tile.y1; y += PACKET_SIZE)
+    {
+        for (int x = tile.x0; x < tile.x1; x += PACKET_SIZE)
         {
-            TriangularLight triangularLight = TriangularLight();
-            triangularLight.vertex1 = Vector3();
-            triangularLight.vertex2 = Vector3();
-            triangularLight.vertex3 = Vector3();
-            triangularLight.intensity = Vector3();
-            triangularLightElement->QueryIntAttribute("id", &triangularLight.id);
-
-            auto vertex1Element = triangularLightElement->FirstChildElement("vertex1");
-            if (vertex1Element)
+            // rays past the edge of the tile are inactive, they repeat a ray of the tile to keep the packet bounds tight
+            for (int row = 0; row < PACKET_SIZE; row++)
             {
-                const char *vertex1Text = vertex1Element->GetText();
-                if (vertex1Text)
+                int j = y + row;
+                generateRowRays(camera, x, std::min(j, tile.y1 - 1), std::min(PACKET_SIZE, tile.x1 - x), batch);
+                for (int column = 0; column < PACKET_SIZE; column++)
                 {
-                    std::istringstream iss(vertex1Text);
-                    iss >> triangularLight.vertex1.x >> triangularLight.vertex1.y >> triangularLight.vertex1.z;
+                    bool inside = column < batch.count && j < tile.y1;
+                    packet.setRay(row * PACKET_SIZE + column, batch.ray(std::min(column, batch.count - 1)), inside);
                 }
+            }
+            packet.prepare();
+            compiled.bvh.intersect(compiled.triangles, compiled.spheres, packet);
 
-                auto vertex2Element = triangularLightElement->FirstChildElement("vertex2");
-                if (vertex2Element)
+            for (int r = 0; r < PACKET_RAYS; r++)
+            {
+                int i = x + r % PACKET_SIZE;
+                int j = y + r / PACKET_SIZE;
+                if (i >= tile.x1 || j >= tile.y1)
                 {
-                    const char *vertex2Text = vertex2Element->GetText();
-                    if (vertex2Text)
-                    {
-                        std::istringstream iss(vertex2Text);
-                        iss >> triangularLight.vertex2.x >> triangularLight.vertex2.y >> triangularLight.vertex2.z;
-                    }
+                    continue;
                 }
 
-                auto vertex3Element = triangularLightElement->FirstChildElement("vertex3");
-                if (vertex3Element)
-                {
-                    const char *vertex3Text = vertex3Element->GetText();
-                    if (vertex3Text)
-                    {
-                        std::istringstream iss(vertex3Text);
-                        iss >> triangularLight.vertex3.x >> triangularLight.vertex3.y >> triangularLight.vertex3.z;
-                    }
-                }
+                threadRayCounters.primaryRays++;
+                Hit hit = packetHit(scene, packet, r);
+                Color3 pixelColor = findPixelColor(scene, hit, camera, packet.rays[r], scene.maxRayTraceDepth);
 
-                auto intensityElement = triangularLightElement->FirstChildElement("intensity");
-                if (intensityElement)
-                {
-                    const char *intensityText = intensityElement->GetText();
-                    if (intensityText)
-                    {
-                        std::istringstream iss(intensityText);
-                        iss >> triangularLight.intensity.x >> triangularLight.intensity.y >> triangularLight.intensity.z;
-                    }
-                }
+                int pixelNumber = ((j * width) + i) * 3;
+                image[pixelNumber] = clampColor(pixelColor.x);
+                image[pixelNumber + 1] = clampColor(pixelColor.y);
+                image[pixelNumber + 2] = clampColor(pixelColor.z);
             }
-
-            scene->triangularLights.push_back(triangularLight);
-            triangularLightElement = triangularLightElement->NextSiblingElement("triangularlight");
         }
     }
+}
 
-    // Accessing materials
-    XMLElement *materialsElement = sceneElement->FirstChildElement("materials");
-    if (materialsElement)
+// first hit of a primary ray whose pixel the rasterizer found covered by triangleId, or -1 when it found none.
+// the triangle only bounds the search, the ray is traced up to just past its hit. every hit closer than
+// that bound is still found, in the same order as by an unbounded trace, so the first hit is the same
+Hit rasterizedFirstHit(const CompiledScene &compiled, const Ray &ray, int triangleId)
+{
+    if (triangleId >= 0)
     {
-        XMLElement *materialElement = materialsElement->FirstChildElement("material");
-        scene->materials = std::vector<Material>();
-        while (materialElement)
+        Hit candidate = triangleIntersection(ray, compiled.triangles[triangleId], (Real)INFINITY);
+        if (candidate.isHit)
         {
-            Material material = Material();
-            material.ambient = Vector3();
-            material.diffuse = Vector3();
-            material.specular = Vector3();
-            material.mirrorReflectance = Vector3();
-            materialElement->QueryIntAttribute("id", &material.id);
-
-            auto ambientElement = materialElement->FirstChildElement("ambient");
-            if (ambientElement)
+            // the margin covers the rounding differences between this kernel and the BVH leaf kernel
+            Hit hit = compiled.bvh.intersect(compiled.triangles, compiled.spheres, ray, candidate.t * Real(1.001));
+            if (hit.isHit)
             {
-                const char *ambientText = ambientElement->GetText();
-                if (ambientText)
-                {
-                    std::istringstream iss(ambientText);
-                    iss >> material.ambient.x >> material.ambient.y >> material.ambient.z;
-                }
+                return closerInstanceHit(compiled, ray, hit);
             }
+        }
+    }
 
-            auto diffuseElement = materialElement->FirstChildElement("diffuse");
-            if (diffuseElement)
-            {
-                const char *diffuseText = diffuseElement->GetText();
-                if (diffuseText)
-                {
-                    std::istringstream iss(diffuseText);
-                    iss >> material.diffuse.x >> material.diffuse.y >> material.diffuse.z;
-                }
-            }
+    // nothing covers the pixel center, or the ray grazes the edge of the triangle and misses it in the BVH kernel
+    return closerInstanceHit(compiled, ray, compiled.bvh.intersect(compiled.triangles, compiled.spheres, ray));
+}
 
-            auto specularElement = materialElement->FirstChildElement("specular");
-            if (specularElement)
-            {
-                const char *specularText = specularElement->GetText();
-                if (specularText)
-                {
-                    std::istringstream iss(specularText);
-                    iss >> material.specular.x >> material.specular.y >> material.specular.z;
-                }
-            }
+// same image as renderTile, the primary visibility of the tile is rasterized first
+RT_MULTIVERSION void renderTileRasterized(const Scene &scene, const Camera &camera, const VisibilityBuffer &visibilityBuffer, const Tile &tile, unsigned char *image)
+{
+    const CompiledScene &compiled = *scene.compiled;
+    int width = camera.imageResolution.nx;
+    int tileWidth = tile.x1 - tile.x0;
+    CameraRayBatch batch;
 
-            auto mirrorReflectanceElement = materialElement->FirstChildElement("mirrorreflectance");
-            if (mirrorReflectanceElement)
-            {
-                const char *mirrorReflectanceText = mirrorReflectanceElement->GetText();
-                if (mirrorReflectanceText)
-                {
-                    std::istringstream iss(mirrorReflectanceText);
-                    iss >> material.mirrorReflectance.x >> material.mirrorReflectance.y >> material.mirrorReflectance.z;
-                }
-            }
+    std::vector<int> triangleIds;
+    visibilityBuffer.rasterize(tile, triangleIds);
+
+    for (int j = tile.y0; j < tile.y1; j++)
+    {
+        for (int x = tile.x0; x < tile.x1; x += RAY_BATCH_SIZE)
+        {
+            generateRowRays(camera, x, j, std::min(RAY_BATCH_SIZE, tile.x1 - x), batch);
 
-            auto phongExponentElement = materialElement->FirstChildElement("phongexponent");
-            if (phongExponentElement)
+            for (int k = 0; k < batch.count; k++)
             {
-                material.phongExponent = phongExponentElement->IntText();
+                Ray ray = batch.ray(k);
+                threadRayCounters.primaryRays++;
+                Hit hit = rasterizedFirstHit(compiled, ray, triangleIds[(j - tile.y0) * tileWidth + x + k - tile.x0]);
+                Color3 pixelColor = findPixelColor(scene, hit, camera, ray, scene.maxRayTraceDepth);
+
+                int pixelNumber = ((j * width) + x + k) * 3;
+                image[pixelNumber] = clampColor(pixelColor.x);
+                image[pixelNumber + 1] = clampColor(pixelColor.y);
+                image[pixelNumber + 2] = clampColor(pixelColor.z);
             }
+        }
+    }
+}
+
+// how the first hits of the primary rays are found
+enum class PrimaryVisibility
+{
+    Rays,
+    Packets,
+    Rasterized
+};
+
+// worker loop, renders tiles until the scheduler runs out of them.
+// visibilityBuffer is only used, and only set, for rasterized primary visibility
+void render(const Scene *scene, const Camera *camera, PrimaryVisibility visibility, const VisibilityBuffer *visibilityBuffer,
+            TileScheduler *scheduler, int worker, unsigned char *image)
+{
+    // packets and the bounded traces of rasterized pixels go through the BVH, without one every ray is traced on its own.
+    // a scene that only has instances needs none
+    const CompiledScene &compiled = *scene->compiled;
+    bool hasBVH = !compiled.bvh.nodes.empty() || (compiled.triangles.empty() && compiled.spheres.size() == 0);
 
-            scene->materials.push_back(material);
-            materialElement = materialElement->NextSiblingElement("material");
+    Tile tile;
+    while (scheduler->nextTile(worker, tile))
+    {
+        if (visibility == PrimaryVisibility::Packets && hasBVH)
+        {
+            renderTilePackets(*scene, *camera, tile, image);
+        }
+        else if (visibility == PrimaryVisibility::Rasterized && hasBVH)
+        {
+            renderTileRasterized(*scene, *camera, *visibilityBuffer, tile, image);
+        }
+        else
+        {
+            renderTile(*scene, *camera, tile, image);
         }
     }
+}
+
+class AdaptiveSampling {
+public:
+    // largest channel difference in a pixel's 3x3 neighborhood, relative to 255, that still counts as flat
+    double threshold = 0.05;
+    // most samples per refined pixel, they are taken on the largest jittered grid that fits
+    int maxSamples = 16;
+    std::atomic<int> refinedPixels{0};
 
-    //     <vertexdata>
-    //     -0.5 0.5 -2
-    //     -0.5 -0.5 -2
-    //     0.5 -0.5 -2
-    //     0.5 0.5 -2
-    //     0.75 0.75 -2
-    //     1 0.75 -2
-    //     0.875 1 -2
-    //     -0.875 1 -2
-    // </vertexdata>
-    // Access vertex data
-    XMLElement *vertexElement = sceneElement->FirstChildElement("vertexdata");
-    if (vertexElement)
+    // side of the sample grid of a refined pixel, below 2 there is nothing to refine with
+    int strata() const
     {
-        std::string vertexText = vertexElement->GetText();
-        std::istringstream iss(vertexText);
-        scene->vertexData = std::vector<Vector3>();
-        while (iss)
+        int side = 0;
+        while ((side + 1) * (side + 1) <= maxSamples)
         {
-            Vector3 vertex = Vector3();
-            iss >> vertex.x >> vertex.y >> vertex.z;
-            scene->vertexData.push_back(vertex);
+            side++;
         }
+        return side;
+    }
+};
+
+// stateless per sample random number in [0, 1), so the result does not depend on the thread layout
+double sampleJitter(int i, int j, int sample)
+{
+    uint32_t h = i * 73856093u ^ j * 19349663u ^ sample * 83492791u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (h >> 8) * (1.0 / 16777216.0);
+}
 
-        // remove the last element
-        scene->vertexData.pop_back();
+// contrast of the first pass result around pixel (i, j)
+double neighborhoodContrast(const unsigned char *firstPass, int width, int height, int i, int j)
+{
+    int minimum[3] = {255, 255, 255};
+    int maximum[3] = {0, 0, 0};
+
+    for (int y = std::max(0, j - 1); y <= std::min(height - 1, j + 1); y++)
+    {
+        for (int x = std::max(0, i - 1); x <= std::min(width - 1, i + 1); x++)
+        {
+            const unsigned char *pixel = firstPass + ((y * width) + x) * 3;
+            for (int c = 0; c < 3; c++)
+            {
+                minimum[c] = std::min(minimum[c], (int)pixel[c]);
+                maximum[c] = std::max(maximum[c], (int)pixel[c]);
+            }
+        }
     }
 
-    // Access objects
-    XMLElement *objectsElement = sceneElement->FirstChildElement("objects");
-    if (objectsElement)
+    int contrast = std::max(maximum[0] - minimum[0], std::max(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+    return contrast / 255.0;
+}
+
+// second pass of adaptive sampling, pixels in high contrast neighborhoods get stratified extra samples
+RT_MULTIVERSION void refineTile(const Scene &scene, const Camera &camera, const Tile &tile, const unsigned char *firstPass, unsigned char *image, AdaptiveSampling *sampling)
+{
+    int width = camera.imageResolution.nx;
+    int height = camera.imageResolution.ny;
+    int strata = sampling->strata();
+    int refined = 0;
 
+    for (int j = tile.y0; j < tile.y1; j++)
     {
-        XMLElement *meshElement = objectsElement->FirstChildElement("mesh");
-        scene->meshes = std::vector<Mesh>();
-        while (meshElement)
+        for (int i = tile.x0; i < tile.x1; i++)
         {
-            Mesh mesh = Mesh();
-            mesh.faces = std::vector<Vector3>();
-            meshElement->QueryIntAttribute("id", &mesh.id);
+            int pixelNumber = ((j * width) + i) * 3;
 
-            auto materialIdElement = meshElement->FirstChildElement("materialid");
-            if (materialIdElement)
+            if (neighborhoodContrast(firstPass, width, height, i, j) <= sampling->threshold)
             {
-                mesh.materialId = materialIdElement->IntText();
+                image[pixelNumber] = firstPass[pixelNumber];
+                image[pixelNumber + 1] = firstPass[pixelNumber + 1];
+                image[pixelNumber + 2] = firstPass[pixelNumber + 2];
+                continue;
             }
 
-            auto facesElement = meshElement->FirstChildElement("faces");
-            if (facesElement)
+            // the first pass sample is replaced by one jittered sample per stratum
+            Color3 sum;
+            for (int sy = 0; sy < strata; sy++)
             {
-                std::string facesText = facesElement->GetText();
-                std::istringstream iss(facesText);
-                std::string line;
-                while (std::getline(iss, line))
+                for (int sx = 0; sx < strata; sx++)
                 {
-                    // trim white spaces
-                    line.erase(line.find_last_not_of(" \n\r\t") + 1);
-                    if (line.empty())
-                    {
-                        continue;
-                    }
-                    std::istringstream lineIss(line);
-                    Vector3 face = Vector3();
-                    lineIss >> face.x >> face.y >> face.z;
-                    mesh.faces.push_back(face);
+                    int sample = sy * strata + sx;
+                    Real x = i + (sx + sampleJitter(i, j, 2 * sample)) / strata;
+                    Real y = j + (sy + sampleJitter(i, j, 2 * sample + 1)) / strata;
+                    sum += tracePixelSample(scene, camera, x, y);
                 }
             }
+            Color3 pixelColor = sum / (strata * strata);
 
-            scene->meshes.push_back(mesh);
-            meshElement = meshElement->NextSiblingElement("mesh");
+            image[pixelNumber] = clampColor(pixelColor.x);
+            image[pixelNumber + 1] = clampColor(pixelColor.y);
+            image[pixelNumber + 2] = clampColor(pixelColor.z);
+            refined++;
         }
     }
+
+    sampling->refinedPixels += refined;
 }
 
-Vector3 findPixelColor(const Scene &scene, const Hit &hitResult, const Camera &currentCamera, const Ray &ray, int maxDepth)
+// worker loop of the refinement pass
+void refine(const Scene *scene, const Camera *camera, TileScheduler *scheduler, int worker, const unsigned char *firstPass, unsigned char *image, AdaptiveSampling *sampling)
+{
+    Tile tile;
+    while (scheduler->nextTile(worker, tile))
+    {
+        refineTile(*scene, *camera, tile, firstPass, image, sampling);
+    }
+}
+
+// renders the image of one camera on the shared worker pool, the caller owns the returned pixels
+unsigned char *renderCamera(const Scene &scene, const Camera &camera, ThreadPool &pool, int tileSize, PrimaryVisibility visibility,
+                            bool adaptiveSampling, double samplingThreshold, int samplingMaxSamples, RenderStats *stats)
 {
-    float pixelX = 0;
-    float pixelY = 0;
-    float pixelZ = 0;
+    int height = camera.imageResolution.ny;
+    int width = camera.imageResolution.nx;
+    unsigned char *image = new unsigned char[width * height * 3];
 
-    Vector3 pixelColor;
+    // small tiles are handed out dynamically so threads that hit cheap regions pick up more work
+    TileScheduler scheduler(width, height, tileSize, pool.threadCount());
 
-    if (hitResult.isHit)
+    VisibilityBuffer visibilityBuffer;
+    if (visibility == PrimaryVisibility::Rasterized)
     {
-        int materialId = hitResult.materialId;
+        visibilityBuffer.setup(camera, scene.compiled->triangles, tileSize);
+    }
 
-        // ambient light
-        // I = ka * Ia
-        // Ia = ambient light
-        // ka = ambient coef of the material
-        pixelX = scene.materials[materialId - 1].ambient.x * scene.ambientLight.x;
-        pixelY = scene.materials[materialId - 1].ambient.y * scene.ambientLight.y;
-        pixelZ = scene.materials[materialId - 1].ambient.z * scene.ambientLight.z;
+    pool.run([&](int worker)
+             { render(&scene, &camera, visibility, &visibilityBuffer, &scheduler, worker, image); });
 
+    // adaptive anti-aliasing, only pixels next to edges found in the first pass are sampled again
+    AdaptiveSampling sampling;
+    if (adaptiveSampling)
+    {
+        if (samplingThreshold >= 0)
+        {
+            sampling.threshold = samplingThreshold;
+        }
+        if (samplingMaxSamples > 0)
+        {
+            sampling.maxSamples = samplingMaxSamples;
+        }
+        else if (camera.numSamples > 1)
+        {
+            sampling.maxSamples = camera.numSamples;
+        }
     }
-    
-    // if no hit
-    else 
+
+    // fewer than 2 x 2 samples per pixel can not refine anything
+    if (adaptiveSampling && sampling.strata() < 2)
     {
-        pixelX = scene.backgroundColor.x;
-        pixelY = scene.backgroundColor.y;
-        pixelZ = scene.backgroundColor.z;
+        std::cout << "Adaptive sampling needs at least 4 samples per pixel, refinement skipped" << std::endl;
     }
+    else if (adaptiveSampling)
+    {
+        unsigned char *firstPass = image;
+        image = new unsigned char[width * height * 3];
+        TileScheduler refineScheduler(width, height, tileSize, pool.threadCount());
 
-    pixelColor.x = pixelX;
-    pixelColor.y = pixelY;
-    pixelColor.z = pixelZ;
+        pool.run([&](int worker)
+                 { refine(&scene, &camera, &refineScheduler, worker, firstPass, image, &sampling); });
+        delete[] firstPass;
 
-    return pixelColor;
+        std::cout << "Adaptive sampling refined " << sampling.refinedPixels << " of " << width * height << " pixels" << std::endl;
+    }
+
+    pool.run([&](int)
+             { stats->collectThreadCounters(); });
+
+    return image;
 }
 
-void render(Scene *scene, int start, int end, unsigned char *image)
+// name with suffix inserted in front of the extension
+std::string withSuffix(const std::string &name, const std::string &suffix)
 {
-    Camera camera = scene->camera;
-    int width = camera.imageResolution.nx;
+    size_t extension = name.rfind('.');
+    if (extension == std::string::npos || name.find('/', extension) != std::string::npos)
+    {
+        return name + suffix;
+    }
+    return name.substr(0, extension) + suffix + name.substr(extension);
+}
 
-    for (int j = start; j < end; j++)
+// file the image of a camera is written to. -o names the image of a single camera scene, otherwise
+// the image name from the scene is used. without either, or when -o is given for several cameras,
+// the output name gets the camera number appended
+std::string imageFileName(const Camera &camera, int cameraIndex, int cameraCount, const std::string &outputName, bool outputNameGiven)
+{
+    if (outputNameGiven && cameraCount == 1)
     {
-        for (int i = 0; i < width; i++)
-        {
-            Ray ray = calculateRay(camera, i, j);
+        return outputName;
+    }
+    if (!outputNameGiven && !camera.imageName.empty())
+    {
+        return camera.imageName;
+    }
+    if (cameraCount == 1)
+    {
+        return outputName;
+    }
 
-            Hit hit = intersectWithObject(*scene, ray);
+    return withSuffix(outputName, "_" + std::to_string(cameraIndex + 1));
+}
 
-            Color3 pixelColor = findPixelColor(*scene, hit, camera, ray, scene->maxRayTraceDepth);
+// frames of an animation are numbered with four digits after the name of the camera image
+std::string frameFileName(const std::string &imageName, int frame)
+{
+    std::string number = std::to_string(frame);
+    return withSuffix(imageName, "_" + std::string(std::max(0, 4 - (int)number.size()), '0') + number);
+}
 
-            int pixelNumber = ((j * width) + i) * 3;
-            image[pixelNumber] = round(pixelColor.x);
-            image[pixelNumber + 1] = round(pixelColor.y);
-            image[pixelNumber + 2] = round(pixelColor.z);
-        }
+double secondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+void printBVHStats(const BVH &bvh)
+{
+    const BVHStats &stats = bvh.stats;
+
+    std::cout << std::endl
+              << "bvh stats" << std::endl;
+    std::cout << "build time: " << stats.buildTime << "s" << std::endl;
+    std::cout << "primitives: " << stats.primitiveCount << " (" << stats.sphereCount << " spheres)" << std::endl;
+    std::cout << "nodes: " << stats.nodeCount << std::endl;
+    std::cout << "leaves: " << stats.leafCount << std::endl;
+    std::cout << "max depth: " << stats.maxDepth << std::endl;
+    std::cout << "leaf size: min " << stats.minLeafSize << " max " << stats.maxLeafSize << " avg "
+              << (stats.leafCount > 0 ? (double)stats.primitiveCount / stats.leafCount : 0) << std::endl;
+    std::cout << "sah cost: " << stats.sahCost << std::endl;
+}
+
+void printInstanceStats(const InstanceBVH &instances)
+{
+    size_t storedTriangles = 0;
+    for (const InstancedMesh &mesh : instances.meshes)
+    {
+        storedTriangles += mesh.triangles.size();
     }
+    // every instanced mesh is placed where the scene defines it as well
+    size_t meshInstances = instances.instances.size() - instances.meshes.size();
+
+    std::cout << std::endl
+              << "instance stats" << std::endl;
+    std::cout << "instances: " << meshInstances << " of " << instances.meshes.size() << " meshes" << std::endl;
+    std::cout << "stored triangles: " << storedTriangles << std::endl;
+    std::cout << "top level nodes: " << instances.nodes.size() << std::endl;
 }
 
 int main(int argc, char *argv[])
 {
     Scene scene = Scene();
 
+    std::string fileName;
+    bool useBVH = true;
+    bool showBVHStats = false;
+    PrimaryVisibility visibility = PrimaryVisibility::Rays;
+    int tileSize = 16;
+    std::string outputName = "output.ppm";
+    bool outputNameGiven = false;
+    bool asciiOutput = false;
+    bool useCache = true;
+    bool adaptiveSampling = false;
+    double samplingThreshold = -1;
+    int samplingMaxSamples = 0;
+    int lightSamples = 0;
+    int resolutionWidth = 0;
+    int resolutionHeight = 0;
+    int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    bool pinThreads = false;
+    std::string statsJsonName;
+    int firstFrame = 0;
+    int lastFrame = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-bvh")
+        {
+            useBVH = false;
+        }
+        else if (arg == "--packets")
+        {
+            visibility = PrimaryVisibility::Packets;
+        }
+        else if (arg == "--raster")
+        {
+            visibility = PrimaryVisibility::Rasterized;
+        }
+        else if (arg == "--bvh-stats")
+        {
+            showBVHStats = true;
+        }
+        else if (arg == "--tile-size" && i + 1 < argc)
+        {
+            tileSize = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            outputName = argv[++i];
+            outputNameGiven = true;
+        }
+        else if (arg == "--ppm-ascii")
+        {
+            asciiOutput = true;
+        }
+        else if (arg == "--no-cache")
+        {
+            useCache = false;
+        }
+        else if (arg == "--aa")
+        {
+            adaptiveSampling = true;
+        }
+        else if (arg == "--aa-threshold" && i + 1 < argc)
+        {
+            samplingThreshold = std::stod(argv[++i]);
+        }
+        else if (arg == "--aa-samples" && i + 1 < argc)
+        {
+            samplingMaxSamples = std::stoi(argv[++i]);
+        }
+        else if (arg == "--light-samples" && i + 1 < argc)
+        {
+            lightSamples = std::stoi(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            numThreads = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--affinity")
+        {
+            pinThreads = true;
+        }
+        else if (arg == "--stats-json" && i + 1 < argc)
+        {
+            statsJsonName = argv[++i];
+        }
+        else if (arg == "--frames" && i + 2 < argc)
+        {
+            firstFrame = std::stoi(argv[++i]);
+            lastFrame = std::stoi(argv[++i]);
+        }
+        else if (arg == "--resolution" && i + 2 < argc)
+        {
+            resolutionWidth = std::stoi(argv[++i]);
+            resolutionHeight = std::stoi(argv[++i]);
+        }
+        else
+        {
+            fileName = arg;
+        }
+    }
+
     if (argc < 2)
     {
-        std::cerr << "Usage: " << argv[0] << " <xml file>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <xml file> [-o output.ppm] [--ppm-ascii] [--no-cache] [--no-bvh] [--bvh-stats] [--packets] [--raster] [--tile-size n]"
+                  << " [--aa] [--aa-threshold t] [--aa-samples n] [--light-samples n]"
+                  << " [--threads n] [--affinity] [--stats-json file] [--frames first last] [--resolution width height]" << std::endl;
         return 1;
     }
 
-    auto fileName = std::string(argv[1]);
-
     if (fileName.empty())
     {
         std::cerr << "File name is empty" << std::endl;
         return 1;
     }
 
-    generateSceneFromXml(fileName, &scene);
+#ifdef RT_DOUBLE
+    // the packet kernels work in single precision, the double build validates the single ray path
+    if (visibility == PrimaryVisibility::Packets)
+    {
+        std::cout << "--packets is ignored in the double precision build" << std::endl;
+        visibility = PrimaryVisibility::Rays;
+    }
+#endif
+    if (visibility == PrimaryVisibility::Packets && !useBVH)
+    {
+        std::cout << "--packets needs the BVH, primary rays are traced one at a time" << std::endl;
+    }
+    if (visibility == PrimaryVisibility::Rasterized && !useBVH)
+    {
+        std::cout << "--raster needs the BVH, primary rays are traced one at a time" << std::endl;
+    }
+
+    // a binary cache next to the xml file skips parsing and compiling when the xml is unchanged
+    std::string cacheName = fileName + ".rtbin";
+    uint64_t sourceHash = useCache ? hashSceneFile(fileName) : 0;
+
+    RenderStats stats;
+    stats.sceneName = fileName;
+    stats.threadCount = numThreads;
+
+    CompiledScene compiled;
+    auto phaseStart = std::chrono::high_resolution_clock::now();
+    if (useCache && loadSceneCache(cacheName, sourceHash, useBVH, &scene, &compiled))
+    {
+        stats.times.parse = secondsSince(phaseStart);
+        stats.loadedFromCache = true;
+        std::cout << "Scene loaded from " << cacheName << std::endl;
+    }
+    else
+    {
+        scene = Scene();
+        compiled = CompiledScene();
+        phaseStart = std::chrono::high_resolution_clock::now();
+        if (!generateSceneFromXml(fileName, &scene))
+        {
+            return 1;
+        }
+        stats.times.parse = secondsSince(phaseStart);
+
+        // flatten the meshes into a triangle buffer and build the acceleration structure over it once
+        phaseStart = std::chrono::high_resolution_clock::now();
+        compileScene(scene, &compiled, useBVH);
+        stats.times.accelerationBuild = secondsSince(phaseStart);
+
+        if (useCache)
+        {
+            if (saveSceneCache(cacheName, sourceHash, useBVH, scene, compiled))
+            {
+                std::cout << "Scene cache saved to " << cacheName << std::endl;
+            }
+            else
+            {
+                std::cerr << "Scene cache could not be written to " << cacheName << std::endl;
+            }
+        }
+    }
+
+    if (useBVH && showBVHStats)
+    {
+        printBVHStats(compiled.bvh);
+    }
+    if (showBVHStats && !compiled.instances.instances.empty())
+    {
+        printInstanceStats(compiled.instances);
+    }
+    scene.compiled = &compiled;
+
+    // the command line sample budget replaces the one of every triangular light
+    if (lightSamples > 0)
+    {
+        for (TriangularLight &light : scene.triangularLights)
+        {
+            light.numSamples = lightSamples;
+        }
+    }
+
+    // the command line resolution replaces the one of every camera, the near planes are kept
+    if (resolutionWidth > 0 && resolutionHeight > 0)
+    {
+        for (Camera &camera : scene.cameras)
+        {
+            camera.imageResolution.nx = resolutionWidth;
+            camera.imageResolution.ny = resolutionHeight;
+        }
+    }
 
-    // precalculate some values for the camera
-    cameraSetup(scene.camera);
+    if (scene.cameras.empty())
+    {
+        std::cerr << "Scene has no camera" << std::endl;
+        return 1;
+    }
 
     auto startTime = std::chrono::high_resolution_clock::now();
 
     std::cout << std::endl << "Rendering has started" << std::endl << std::endl;
 
-    int numThreads = std::thread::hardware_concurrency(); // Get the number of hardware threads
-    std::vector<std::thread> threads;
+    // the workers are started once and reused by every pass and camera
+    ThreadPool pool(numThreads, pinThreads);
 
-    int height = scene.camera.imageResolution.ny;
-    int width = scene.camera.imageResolution.nx;
-    unsigned char *image = new unsigned char[width * height * 3];
-
-    int rowsPerThread = height / numThreads;
-    int start = 0;
-    int end = rowsPerThread;
+    int cameraCount = scene.cameras.size();
+    stats.cameraCount = cameraCount;
 
-    for (int t = 0; t < numThreads; ++t) {
-        threads.emplace_back(render, &scene, start, end, image);
-        start = end;
-        end = (t == numThreads - 2) ? height : std::min(end + rowsPerThread, height);
+    // the scene is loaded and compiled once, every camera renders from the same acceleration structure.
+    // an animated scene renders every camera once per frame, only the animated cameras and objects
+    // are moved between frames
+    bool animated = scene.animation.frameCount > 0;
+    if (!animated)
+    {
+        if (lastFrame >= 0)
+        {
+            std::cout << "--frames is ignored, the scene has no animation" << std::endl;
+        }
+        firstFrame = 0;
+        lastFrame = 0;
     }
+    else if (lastFrame < 0 || lastFrame >= scene.animation.frameCount)
+    {
+        lastFrame = scene.animation.frameCount - 1;
+    }
+    firstFrame = std::max(firstFrame, 0);
+    stats.frameCount = std::max(0, lastFrame - firstFrame + 1);
 
-    // wait for all threads to finish
-    for (auto& t : threads) {
-        t.join();
+    SceneAnimator animator;
+    if (animated)
+    {
+        phaseStart = std::chrono::high_resolution_clock::now();
+        animator.setup(scene, compiled);
+        stats.times.sceneUpdate += secondsSince(phaseStart);
     }
 
-    write_ppm("output.ppm", image, width, height);
+    for (int frame = firstFrame; frame <= lastFrame; frame++)
+    {
+        if (animated)
+        {
+            phaseStart = std::chrono::high_resolution_clock::now();
+            animator.applyFrame(frame, &scene, &compiled);
+            stats.times.sceneUpdate += secondsSince(phaseStart);
+        }
+
+        for (int c = 0; c < cameraCount; c++)
+        {
+            Camera &camera = scene.cameras[c];
+
+            // precalculate some values for the camera
+            phaseStart = std::chrono::high_resolution_clock::now();
+            cameraSetup(camera);
+            stats.times.cameraSetup += secondsSince(phaseStart);
+
+            int height = camera.imageResolution.ny;
+            int width = camera.imageResolution.nx;
+            stats.pixelCount += (uint64_t)width * height;
+
+            phaseStart = std::chrono::high_resolution_clock::now();
+            unsigned char *image = renderCamera(scene, camera, pool, tileSize, visibility, adaptiveSampling, samplingThreshold, samplingMaxSamples, &stats);
+            stats.times.render += secondsSince(phaseStart);
+
+            phaseStart = std::chrono::high_resolution_clock::now();
+            std::string imageName = imageFileName(camera, c, cameraCount, outputName, outputNameGiven);
+            if (animated)
+            {
+                imageName = frameFileName(imageName, frame);
+            }
+            if (asciiOutput)
+            {
+                write_ppm_ascii(imageName.c_str(), image, width, height);
+            }
+            else
+            {
+                write_ppm(imageName.c_str(), image, width, height);
+            }
+            delete[] image;
+            stats.times.imageWrite += secondsSince(phaseStart);
+
+            std::cout << "Camera " << camera.id << " written to " << imageName << std::endl;
+        }
+    }
 
     auto endTime = std::chrono::high_resolution_clock::now();
 
     std::chrono::duration<double> elapsed = endTime - startTime;
     std::cout << std::endl << "Elapsed time: " << elapsed.count() << "s" << std::endl;
 
+    std::cout << std::endl;
+    stats.print(std::cout);
+    if (!statsJsonName.empty() && !stats.writeJson(statsJsonName))
+    {
+        std::cerr << "Stats could not be written to " << statsJsonName << std::endl;
+    }
+
     // comment out the following line to see the scene data
     // debugScene(scene);
 
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,11 +1,37 @@
 #include "ppm.h"
 #include <stdexcept>
 #include <iostream>
+#include <cstdio>
 
 void write_ppm(const char* filename, unsigned char* data, int width, int height)
 {
     FILE *outfile;
 
+    if ((outfile = fopen(filename, "wb")) == NULL) 
+    {
+        throw std::runtime_error("Error: The ppm file cannot be opened for writing.");
+    }
+
+    char header[64];
+    int headerLength = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+    size_t dataLength = (size_t)width * height * 3;
+    if (fwrite(header, 1, headerLength, outfile) != (size_t)headerLength ||
+        fwrite(data, 1, dataLength, outfile) != dataLength)
+    {
+        (void) fclose(outfile);
+        throw std::runtime_error("Error: The ppm file cannot be written.");
+    }
+
+    std::cout << "Image saved to " << filename << std::endl;
+
+    (void) fclose(outfile);
+}
+
+void write_ppm_ascii(const char* filename, unsigned char* data, int width, int height)
+{
+    FILE *outfile;
+
     if ((outfile = fopen(filename, "w")) == NULL) 
     {
         throw std::runtime_error("Error: The ppm file cannot be opened for writing.");
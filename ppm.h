@@ -1,6 +1,10 @@
 #ifndef __ppm_h__
 #define __ppm_h__
 
+// binary P6 image, the header and pixel data are written with one fwrite each
 void write_ppm(const char* filename, unsigned char* data, int width, int height);
 
+// plain text P3 image, larger and much slower to write
+void write_ppm_ascii(const char* filename, unsigned char* data, int width, int height);
+
 #endif // __ppm_h__